@@ -58,7 +58,7 @@ int main() {
         .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
         .pEngineName = "Immediate Mode Vulkan",
         .engineVersion = VK_MAKE_VERSION(1, 0, 0),
-        .apiVersion = VK_API_VERSION_1_0
+        .apiVersion = VK_API_VERSION_1_1
     };
 
     // look up extensions needed by GLFW
@@ -97,12 +97,12 @@ int main() {
             &createInfo, nullptr, out_ptr(instance)
         ));
     }
-    imv::current_instance = instance.get();
 
     // create surface
     imv::unique_surface surface;
     imv::check(glfwCreateWindowSurface(
-        instance.get(), window.get(), nullptr, out_ptr(surface)
+        instance.get(), window.get(), nullptr, 
+        imv::owned_out_ptr(surface, instance.get())
     ));
 
     imv::renderer r(instance.get(), surface.get());
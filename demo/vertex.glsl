@@ -1,7 +1,7 @@
 #version 450
 #pragma shader_stage(vertex)
 
-layout (std140, binding = 0) uniform parameters {
+layout (push_constant) uniform parameters {
     float time;
 };
 
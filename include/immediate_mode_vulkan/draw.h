@@ -1,20 +1,70 @@
 #include <vulkan/vulkan.h>
+#include <array>
 #include <cstdint>
 #include <initializer_list>
 #include <memory>
+#include <optional>
 #include <string_view>
 
 namespace imv {
+    // what calls do while the queue of the render thread is full
+    enum class queue_policy {
+        // wait for the render thread
+        block,
+        // draws and dispatches are dropped and return false
+        drop,
+        // the queue is replaced by a larger one
+        grow,
+    };
+
+    struct renderer_info {
+        // falls back to VK_PRESENT_MODE_FIFO_KHR if not supported by the 
+        // surface
+        VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+        // number of frames that can be recorded while previous ones are 
+        // still rendering, independent of the number of swapchain images
+        uint32_t frames_in_flight = 2;
+        // threads compiling pipelines for draws that don't block on them, 0
+        // leaves one hardware thread for the caller
+        uint32_t compile_threads = 0;
+        // bytes of textures kept loaded, 0 uses the budget reported by
+        // VK_EXT_memory_budget if supported, and no limit otherwise
+        VkDeviceSize texture_budget = 0;
+        // textures are only evicted if they weren't used for this many 
+        // frames, they are reloaded when used again
+        uint32_t texture_eviction_frames = 60;
+        // format of a depth attachment for each swapchain image, none if 
+        // VK_FORMAT_UNDEFINED
+        VkFormat depth_format = VK_FORMAT_UNDEFINED;
+        // restricts the GPU to those whose name contains this, the fastest 
+        // one that can present to the surface is used otherwise
+        std::string_view device_name;
+        // restricts the GPU to the one with this VkPhysicalDeviceIDProperties
+        // deviceUUID
+        std::optional<std::array<uint8_t, VK_UUID_SIZE>> device_uuid;
+        // calls only copy their arguments into a queue and return, a render
+        // thread records and submits them. Draws and dispatches then return 
+        // true once queued, and errors are thrown by the next wait_frame or 
+        // submit. Calls on the renderer have to come from a single thread
+        bool render_thread = false;
+        // bytes of queued calls, a single call has to fit unless the queue 
+        // grows
+        size_t queue_capacity = 16 * 1024 * 1024;
+        queue_policy queue_full = queue_policy::block;
+    };
+
     struct renderer {
         renderer(
-            VkInstance instance, VkSurfaceKHR surface
+            VkInstance instance, VkSurfaceKHR surface, 
+            const renderer_info& info = {}
         );
         ~renderer();
 
         std::unique_ptr<struct renderer_data> d;
     };
 
-    extern struct renderer* global_renderer;
+    // used by calls without a renderer, each thread can set its own
+    extern thread_local struct renderer* global_renderer;
 
     void wait_frame(renderer* renderer = nullptr);
 
@@ -22,6 +72,11 @@ namespace imv {
         // TODO: replace with string_view
         const char* code_file_name;
         VkPipelineShaderStageCreateInfo info;
+        // each combination of constant values is compiled into its own
+        // pipeline, info.pSpecializationInfo is ignored
+        std::initializer_list<VkSpecializationMapEntry> specialization_entries;
+        const void* specialization_data = nullptr;
+        size_t specialization_data_size = 0;
     };
 
     struct vertex_binding_info {
@@ -33,21 +88,135 @@ namespace imv {
 
     struct image_info {
         std::string_view file_name;
+        // a linear, repeating sampler is used if sType is not set
         VkSamplerCreateInfo sampler_info;
+        // samples a pass attachment instead of a file, the pass drawing it
+        // has to be begun before this draw
+        std::string_view render_target;
+    };
+
+    struct storage_buffer_info {
+        // device local buffer kept across frames, zeroed when created on 
+        // first use and recreated when its size changes
+        std::string_view name;
+        VkDeviceSize size;
+    };
+
+    // what a draw does while its pipeline is compiling. With graphics 
+    // pipeline libraries, draws use a pipeline linked from separately 
+    // compiled parts until the optimized one is ready, and only wait for, 
+    // skip or fall back while those parts compile
+    enum class compile_policy {
+        // waits for the pipeline
+        block,
+        // draws nothing and returns false
+        skip,
+        // draws with fallback_stages instead, blocking on their pipeline
+        fallback,
+    };
+
+    // the bounding sphere and frustum planes have to be in the same space
+    struct culling_info {
+        // center and radius
+        std::array<float, 4> bounding_sphere;
+        // points p with dot(plane.xyz, p) + plane.w < 0 are outside
+        std::array<std::array<float, 4>, 6> frustum_planes;
     };
 
     struct draw_info {
         renderer* renderer = nullptr;
+        // creates the pipeline and loads the textures without recording 
+        // anything, can be called before the first wait_frame. Returns 
+        // false while a non blocking compile is in progress, blocking waits
+        // for the optimized pipeline. With a render thread, the compile 
+        // state isn't reported, see draw
         bool prepare_only = false;
         std::initializer_list<stage_info> stages;
         std::initializer_list<vertex_binding_info> vertex_input_bindings;
         std::initializer_list<image_info> images;
+        // usually written by dispatches, bound to the storage blocks of the 
+        // shaders in binding order, after the draw data block
+        std::initializer_list<storage_buffer_info> storage_buffers;
+        // delivered as push constants if the shaders declare a push constant
+        // block instead of a uniform block. Without either, it is delivered
+        // in the first storage block, the draw data block
         const void* uniform_source_pointer;
         VkDeviceSize uniform_source_size;
         uint32_t vertex_count = 0;
+        VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+        // ignored without a depth attachment
+        bool depth_test = false;
+        bool depth_write = true;
+        VkCompareOp depth_compare = VK_COMPARE_OP_LESS;
+        // opaque draws with a key are recorded when their pass ends, front 
+        // to back by increasing key and before the draws without one, so 
+        // early depth testing skips shading hidden fragments
+        std::optional<float> depth_key;
+        // consecutive batched draws with the same state in a pass become a
+        // single indirect draw. The uniform source is then this draw's
+        // element of the array in the draw data block, indexed by gl_DrawID.
+        // Ignores depth_key
+        bool batch = false;
+        // batched draws are culled on the GPU before the frame's passes, 
+        // those outside the frustum draw no instances. Ignored by other 
+        // draws
+        std::optional<culling_info> culling;
+        compile_policy compile = compile_policy::block;
+        // usually cheap shaders with the same interface as stages
+        std::initializer_list<stage_info> fallback_stages;
     };
 
+    // Returns whether the draw was recorded. With a render thread, it only 
+    // returns whether the draw was queued, false if it was dropped, not 
+    // whether the render thread records it
     bool draw(const draw_info&);
 
+    struct dispatch_info {
+        renderer* renderer = nullptr;
+        stage_info stage;
+        // bound to the storage blocks of the shader in binding order
+        std::initializer_list<storage_buffer_info> storage_buffers;
+        // delivered like the uniform source of draws
+        const void* uniform_source_pointer = nullptr;
+        VkDeviceSize uniform_source_size = 0;
+        uint32_t group_count_x = 1;
+        uint32_t group_count_y = 1;
+        uint32_t group_count_z = 1;
+        // fallback is treated like skip
+        compile_policy compile = compile_policy::block;
+    };
+
+    // Dispatches of a frame run in order before all of its passes, each 
+    // waiting for the writes of the previous ones, and the draws wait for 
+    // all of them. Returns false if nothing was dispatched, or with a render
+    // thread, only if the dispatch was dropped from the queue
+    bool dispatch(const dispatch_info&);
+
+    struct attachment_info {
+        // offscreen image, created on first use and recreated when its 
+        // format or size changes
+        std::string_view name;
+        VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+        // keeps the previous contents instead of clearing them
+        bool load = false;
+        VkClearColorValue clear_color = {};
+    };
+
+    struct pass_info {
+        renderer* renderer = nullptr;
+        std::initializer_list<attachment_info> color_attachments;
+        // the size of the window if 0
+        VkExtent2D extent = {};
+    };
+
+    // Draws until end_pass go to the attachments instead of the window. 
+    // Passes are submitted in the order they were begun, before the window
+    // is drawn. Attachments are only written to memory if they are sampled
+    // or loaded afterwards, and only kept across frames if they are read
+    // before being drawn in a frame.
+    void begin_pass(const pass_info&);
+
+    void end_pass(renderer* renderer = nullptr);
+
     void submit(renderer* renderer = nullptr);
 }
\ No newline at end of file
@@ -5,8 +5,6 @@
 #include <memory>
 
 namespace imv {
-    extern VmaAllocator current_allocator;
-
     struct vulkan_memory_allocator_deleter {
         typedef VmaAllocator pointer;
         void operator()(VmaAllocator allocator) {
@@ -18,8 +16,9 @@ namespace imv {
     template<typename T, void(*Deleter)(VmaAllocator, T)>
     struct vulkan_memory_allocator_handle_deleter {
         typedef T pointer;
+        VmaAllocator allocator = VK_NULL_HANDLE;
         void operator()(T object) {
-            Deleter(current_allocator, object);
+            Deleter(allocator, object);
         }
     };
 
@@ -32,4 +31,7 @@ namespace imv {
 
     using unique_allocation = 
         unique_vulkan_memory_allocator_handle<VmaAllocation, vmaFreeMemory>;
+
+    using unique_pool = 
+        unique_vulkan_memory_allocator_handle<VmaPool, vmaDestroyPool>;
 }
\ No newline at end of file
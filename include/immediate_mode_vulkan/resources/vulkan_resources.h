@@ -13,9 +13,6 @@ namespace imv {
         }
     }
 
-    extern VkDevice current_device;
-    extern VkInstance current_instance;
-
     struct vulkan_device_deleter {
         typedef VkDevice pointer;
         void operator()(VkDevice device) {
@@ -32,12 +29,13 @@ namespace imv {
 
     struct vulkan_fence_deleter {
         typedef VkFence pointer;
+        VkDevice device = VK_NULL_HANDLE;
         void operator()(VkFence fence) {
             VkResult result = 
-                vkWaitForFences(current_device, 1, &fence, VK_TRUE, ~0ul);
+                vkWaitForFences(device, 1, &fence, VK_TRUE, ~0ul);
             // fence needs to be cleaned up regardless of whether waiting 
             // succeeded
-            vkDestroyFence(current_device, fence, nullptr);
+            vkDestroyFence(device, fence, nullptr);
             if (std::uncaught_exceptions())
                 // Destructor was called during stack unwinding, throwing a new 
                 // exception would terminate the application.
@@ -46,6 +44,8 @@ namespace imv {
         }
     };
 
+    // deleters keep the object that created the handle, so handles of 
+    // different devices can be used side by side
     template<typename T, auto Deleter>
     struct vulkan_handle_deleter;
 
@@ -54,8 +54,9 @@ namespace imv {
     >
     struct vulkan_handle_deleter<T, Deleter> {
         typedef T pointer;
+        VkDevice device = VK_NULL_HANDLE;
         void operator()(T object) {
-            Deleter(current_device, object, nullptr);
+            Deleter(device, object, nullptr);
         }
     };
 
@@ -64,19 +65,31 @@ namespace imv {
     >
     struct vulkan_handle_deleter<T, Deleter> {
         typedef T pointer;
+        VkInstance instance = VK_NULL_HANDLE;
         void operator()(T object) {
-            Deleter(current_instance, object, nullptr);
+            Deleter(instance, object, nullptr);
         }
     };
 
     struct vulkan_descriptor_set_deleter {
         typedef VkDescriptorSet pointer;
-        VkDescriptorPool pool;
+        VkDevice device = VK_NULL_HANDLE;
+        VkDescriptorPool pool = VK_NULL_HANDLE;
         void operator()(VkDescriptorSet object) {
-            check(vkFreeDescriptorSets(current_device, pool, 1, &object));
+            check(vkFreeDescriptorSets(device, pool, 1, &object));
         }
     };
 
+    // out_ptr for handles whose deleter needs the object creating them
+    template<typename Handle, typename Owner>
+    auto owned_out_ptr(Handle& handle, Owner owner) {
+        handle = Handle(
+            typename Handle::pointer{}, 
+            typename Handle::deleter_type{owner}
+        );
+        return std::out_ptr(handle);
+    }
+
     template<typename T, auto Deleter>
     using unique_vulkan_handle = 
         std::unique_ptr<T, vulkan_handle_deleter<T, Deleter>>;
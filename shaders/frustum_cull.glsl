@@ -0,0 +1,37 @@
+#version 450
+#pragma shader_stage(compute)
+
+layout (local_size_x = 64) in;
+
+layout (push_constant) uniform parameters {
+    vec4 frustum_planes[6];
+    uint draw_count;
+};
+
+layout (std430, binding = 0) readonly buffer bounds {
+    vec4 bounding_spheres[];
+};
+
+struct draw_command {
+    uint vertex_count;
+    uint instance_count;
+    uint first_vertex;
+    uint first_instance;
+};
+
+layout (std430, binding = 1) buffer commands {
+    draw_command draw_commands[];
+};
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= draw_count)
+        return;
+    vec4 sphere = bounding_spheres[index];
+    bool visible = true;
+    for (int i = 0; i < 6; i++) {
+        vec4 plane = frustum_planes[i];
+        visible = visible && dot(plane.xyz, sphere.xyz) + plane.w >= -sphere.w;
+    }
+    draw_commands[index].instance_count = visible ? 1 : 0;
+}
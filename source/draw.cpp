@@ -4,12 +4,27 @@
 #include <immediate_mode_vulkan/resources/vulkan_memory_allocator_resource.h>
 #include <immediate_mode_vulkan/resources/ktx_resources.h>
 #include "serialize.h"
+#include "flat_hash_map.h"
+#include "reflect.h"
+#include "thread_pool.h"
+#include "spsc_ring.h"
 #include "vulkan/vulkan_core.h"
 
 #include <memory>
 #include <vector>
 #include <unordered_map>
 #include <filesystem>
+#include <cstring>
+#include <memory_resource>
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <numeric>
+#include <span>
+#include <tuple>
+#include <exception>
+#include <mutex>
+#include <thread>
 
 #include <ktx.h>
 
@@ -17,15 +32,230 @@ using namespace std;
 
 namespace imv {
 
-    renderer* global_renderer;
+    thread_local renderer* global_renderer;
 
     size_t aligned(size_t size, size_t alignment) {
         return alignment * ((size - 1) / alignment + 1);
     }
 
+    // with dynamic topology, pipelines only need to know the topology class
+    VkPrimitiveTopology topology_class(VkPrimitiveTopology topology) {
+        switch (topology) {
+        case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+            return VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+        case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+        case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+        case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+        case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+            return VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+        case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
+            return VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
+        default:
+            return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        }
+    }
+
     struct image {
-        vector<unique_pipeline> pipelines;
-        vector<unique_sampler> samplers;
+        unique_framebuffer swapchain_framebuffer;
+        unique_image_view swapchain_image_view;
+
+        // null without renderer_info::depth_format
+        unique_allocation depth_allocation;
+        unique_image depth_image;
+        unique_image_view depth_view;
+
+        // presentation waits on this, so it has to be per swapchain image
+        unique_semaphore render_finished_semaphore;
+    };
+
+    struct view {
+        unsigned image_count;
+        VkSurfaceCapabilitiesKHR capabilities;
+        VkExtent2D extent;
+        unique_swapchain swapchain;
+
+        unique_ptr<VkImage[]> swapchain_images;
+        unique_ptr<image[]> images;
+        uint32_t image_index;
+
+        // set when presentation reported the swapchain to be suboptimal or
+        // out of date, it is recreated at the start of the next frame
+        bool outdated = false;
+    };
+
+    // commands recording a draw, the arrays are owned by the caller
+    struct draw_commands {
+        VkPipeline pipeline;
+        VkPipelineLayout pipeline_layout;
+        VkPrimitiveTopology topology;
+        // empty without dynamic vertex input
+        span<const VkVertexInputBindingDescription2EXT> vertex_bindings;
+        span<const VkVertexInputAttributeDescription2EXT> vertex_attributes;
+        span<const VkBuffer> vertex_buffers;
+        span<const VkDeviceSize> vertex_offsets;
+        VkDescriptorSet descriptor_set;
+        VkShaderStageFlags push_constant_stages;
+        span<const std::byte> push_constants;
+        uint32_t vertex_count;
+        // set for batches, which draw up to draw_count commands from it
+        VkBuffer indirect_buffer = VK_NULL_HANDLE;
+        VkDeviceSize indirect_offset = 0;
+        // offset of the number of commands to draw
+        VkDeviceSize count_offset = 0;
+        uint32_t draw_count = 0;
+    };
+
+    // a draw recorded when its pass ends. Its commands keep the sizes of 
+    // their arrays, whose copies start at the offsets
+    struct deferred_draw {
+        float depth_key;
+        draw_commands commands;
+        size_t vertex_bindings;
+        size_t vertex_attributes;
+        // also of the vertex offsets
+        size_t vertex_buffers;
+        size_t push_constants;
+    };
+
+    // the deferred draws of a pass with copies of their arrays, which keep
+    // their capacity across frames
+    struct deferred_draw_list {
+        void push_back(float key, const draw_commands& commands) {
+            draws.push_back({
+                .depth_key = key,
+                .commands = commands,
+                .vertex_bindings = vertex_bindings.size(),
+                .vertex_attributes = vertex_attributes.size(),
+                .vertex_buffers = vertex_buffers.size(),
+                .push_constants = push_constants.size(),
+            });
+            auto append = [](auto& array, auto source) {
+                array.insert(array.end(), source.begin(), source.end());
+            };
+            append(vertex_bindings, commands.vertex_bindings);
+            append(vertex_attributes, commands.vertex_attributes);
+            append(vertex_buffers, commands.vertex_buffers);
+            append(vertex_offsets, commands.vertex_offsets);
+            append(push_constants, commands.push_constants);
+        }
+
+        // points the commands of the draw to the copies
+        draw_commands get(const deferred_draw& draw) const {
+            auto result = draw.commands;
+            result.vertex_bindings = span(vertex_bindings).subspan(
+                draw.vertex_bindings, result.vertex_bindings.size()
+            );
+            result.vertex_attributes = span(vertex_attributes).subspan(
+                draw.vertex_attributes, result.vertex_attributes.size()
+            );
+            result.vertex_buffers = span(vertex_buffers).subspan(
+                draw.vertex_buffers, result.vertex_buffers.size()
+            );
+            result.vertex_offsets = span(vertex_offsets).subspan(
+                draw.vertex_buffers, result.vertex_offsets.size()
+            );
+            result.push_constants = span(push_constants).subspan(
+                draw.push_constants, result.push_constants.size()
+            );
+            return result;
+        }
+
+        void clear() {
+            draws.clear();
+            vertex_bindings.clear();
+            vertex_attributes.clear();
+            vertex_buffers.clear();
+            vertex_offsets.clear();
+            push_constants.clear();
+        }
+
+        vector<deferred_draw> draws;
+        vector<VkVertexInputBindingDescription2EXT> vertex_bindings;
+        vector<VkVertexInputAttributeDescription2EXT> vertex_attributes;
+        vector<VkBuffer> vertex_buffers;
+        vector<VkDeviceSize> vertex_offsets;
+        vector<std::byte> push_constants;
+    };
+
+    // offscreen image drawn by passes and sampled by draws
+    struct render_target {
+        shared_ptr<unique_allocation> allocation;
+        shared_ptr<unique_image> image;
+        shared_ptr<unique_image_view> view;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkExtent2D extent = {};
+        // set once the contents were sampled or loaded, the image is 
+        // transient and lazily allocated until then
+        bool read = false;
+        bool transient = true;
+        // set once the contents were read before being drawn in a frame, 
+        // they are then kept across frames
+        bool persistent = false;
+        uint64_t drawn_frame = 0;
+        // layout the submitted passes leave the image in, undefined if its
+        // contents weren't stored
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    };
+
+    // device local buffer written by dispatches, kept across frames
+    struct storage_buffer {
+        shared_ptr<unique_allocation> allocation;
+        shared_ptr<unique_buffer> buffer;
+        VkDeviceSize size = 0;
+    };
+
+    struct pass_attachment {
+        render_target* target;
+        bool load;
+        VkClearValue clear_value;
+    };
+
+    // consecutive compatible draws, recorded as one indirect draw
+    struct draw_batch {
+        // null while the batch is empty
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        const struct program* program;
+        VkPrimitiveTopology topology;
+        size_t draw_data_size;
+        vector<VkVertexInputBindingDescription> vertex_bindings;
+        vector<VkVertexInputAttributeDescription> vertex_attributes;
+        vector<VkDescriptorImageInfo> images;
+        vector<VkDescriptorBufferInfo> storage_buffers;
+        // vertices of each binding, draws start at their firstVertex
+        vector<vector<std::byte>> vertex_data;
+        uint32_t vertex_count = 0;
+        vector<VkDrawIndirectCommand> commands;
+        vector<std::byte> draw_data;
+        // set if the draws are culled on the GPU
+        bool culled = false;
+        std::array<std::array<float, 4>, 6> frustum_planes;
+        vector<std::array<float, 4>> bounding_spheres;
+    };
+
+    // draws recorded into a secondary command buffer, so the render pass
+    // executing them can be chosen on submit, when it is known how later 
+    // passes use the attachments
+    struct pass {
+        VkCommandBuffer command_buffer;
+        // empty for the window
+        vector<pass_attachment> attachments;
+        vector<render_target*> sampled;
+        VkExtent2D extent;
+        // compatible with the render pass it is executed in, null with 
+        // dynamic rendering
+        VkRenderPass render_pass;
+        // all that pipelines and command buffers depend on with dynamic
+        // rendering
+        vector<VkFormat> color_formats;
+        bool depth = false;
+        // draws with a depth key, recorded into sorted_command_buffer 
+        // when the pass ends, which runs before command_buffer
+        deferred_draw_list deferred_draws;
+        VkCommandBuffer sorted_command_buffer = VK_NULL_HANDLE;
+        draw_batch batch;
+    };
+
+    struct frame {
 
         // TODO: allocate uniform data from a shared buffer
         size_t uniform_buffer_size = 0, uniform_buffer_capacity = 1024 * 1024;
@@ -37,66 +267,357 @@ namespace imv {
         unique_buffer vertex_buffer;
         unique_allocation vertex_allocation;
 
-        unique_framebuffer swapchain_framebuffer;
-        unique_image_view swapchain_image_view;
+        // storage blocks of the draws
+        size_t draw_data_size = 0, draw_data_capacity = 16 * 1024 * 1024;
+        unique_buffer draw_data_buffer;
+        unique_allocation draw_data_allocation;
 
-        vector<shared_ptr<unique_device_memory>> image_memories;
-        vector<shared_ptr<unique_image>> images;
-        vector<shared_ptr<unique_image_view>> image_views;
+        // commands of each batch, followed by their count
+        size_t indirect_buffer_size = 0;
+        size_t indirect_buffer_capacity = 4 * 1024 * 1024;
+        unique_buffer indirect_buffer;
+        unique_allocation indirect_allocation;
 
         vector<unique_descriptor_set> descriptor_sets;
         VkCommandBuffer command_buffer;
 
-        unique_semaphore render_finished_semaphore;
-        unique_fence render_finished_fence;
+        // secondary command buffers, reused by the passes of later frames
+        vector<VkCommandBuffer> pass_command_buffers;
+        size_t pass_command_buffers_used = 0;
+        // dispatches of the frame, null until the first one
+        VkCommandBuffer compute_command_buffer = VK_NULL_HANDLE;
+        // the window's pass comes first, but is submitted last
+        vector<imv::pass> passes;
+        // passes of earlier frames, whose arrays keep their capacity
+        vector<imv::pass> free_passes;
+        // index of the pass draws are recorded to
+        size_t current_pass = 0;
+
+        // texture uploads, submitted before command_buffer. With a transfer
+        // queue, they are submitted to it and acquired by the graphics queue
+        // in acquire_command_buffer
+        VkCommandBuffer upload_command_buffer;
+        // null without a transfer queue
+        VkCommandBuffer acquire_command_buffer = VK_NULL_HANDLE;
+        unique_semaphore upload_finished_semaphore;
+        size_t staging_buffer_capacity = 0;
+        unique_buffer staging_buffer;
+        unique_allocation staging_allocation;
+
+        unique_semaphore swapchain_image_ready_semaphore;
+        // value of the timeline semaphore signaled when the frame finished
+        uint64_t timeline_value = 0;
+
+        // keeps the swapchain, image views and framebuffers used by this 
+        // frame alive while it is rendering
+        shared_ptr<imv::view> view;
     };
 
-    struct view {
-        unsigned image_count;
-        VkSurfaceCapabilitiesKHR capabilities;
-        VkExtent2D extent;
-        unique_swapchain swapchain;
+    struct watched_file {
+        filesystem::path path;
+        filesystem::file_time_type last_update = 
+            filesystem::file_time_type::min();
+        uint64_t last_check = ~0ull;
+    };
 
-        unique_ptr<VkImage[]> swapchain_images;
-        unique_ptr<image[]> images;
-        uint32_t image_index;
+    // returns true if the file was modified since it was last loaded, the 
+    // file system is queried at most once per frame
+    bool modified(watched_file& file, uint64_t frame_number) {
+        if (file.last_check == frame_number)
+            return false;
+        file.last_check = frame_number;
+        auto last_write = filesystem::last_write_time(file.path);
+        if (last_write <= file.last_update)
+            return false;
+        file.last_update = last_write;
+        return true;
+    }
+
+    // a texture loaded since the last submit, uploaded by it
+    struct texture_upload {
+        unique_ktx_texture2 texture;
+        shared_ptr<unique_image> image;
+        shared_ptr<unique_allocation> allocation;
     };
 
     struct image_file {
-        shared_ptr<unique_device_memory> device_memory;
+        shared_ptr<unique_allocation> allocation;
         shared_ptr<unique_image> image;
         shared_ptr<unique_image_view> view;
-        filesystem::file_time_type last_update;
+        watched_file file;
+        VkDeviceSize size = 0;
+        uint64_t last_use = 0;
+    };
+
+    // one per distinct SPIR-V code, however many files contain it
+    struct shader_code {
+        // shared with pipelines that are still compiling
+        shared_ptr<unique_shader_module> shader_module;
+        shader_reflection reflection;
+        // of the SPIR-V words, the key in shader_codes
+        hash128 hash;
     };
 
     struct shader_module_file {
-        unique_shader_module shader_module;
-        filesystem::file_time_type last_update;
+        // null until the file was loaded once
+        shader_code* code = nullptr;
+        watched_file file;
+    };
+
+    // part of the keys of caches depending on shader stages, which identify
+    // modules by their code, since a destroyed module's handle can be reused
+    struct code_hashes {
+        span<const hash128> hashes;
     };
 
+    void visit(auto&& visitor, auto&& object, tag_t<code_hashes>) {
+        for (const auto& hash : object.hashes) {
+            visitor.push_back(hash.low);
+            visitor.push_back(hash.high);
+        }
+    }
+
+    // whether a key contains the hash of the code
+    bool uses_code(span<const uint64_t> key, hash128 hash) {
+        for (size_t i = 0; i + 1 < key.size(); i++) {
+            if (key[i] == hash.low && key[i + 1] == hash.high)
+                return true;
+        }
+        return false;
+    }
+
     struct pipeline {
         unique_descriptor_set_layout descriptor_set_layout;
         unique_pipeline_layout pipeline_layout;
         unique_pipeline pipeline;
     };
 
-    struct string_hash : std::hash<string_view> {
-        typedef void is_transparent;
-    };
+    // owns everything a graphics pipeline create info points to, so the 
+    // pipeline can be compiled after the draw returned
+    struct pipeline_state {
+        pipeline_state(
+            const VkGraphicsPipelineCreateInfo& info,
+            span<const shared_ptr<unique_shader_module>> modules
+        ) : create_info(info), shader_modules(modules.begin(), modules.end()) {
+            for (uint32_t i = 0; i < info.stageCount; i++) {
+                auto stage = info.pStages[i];
+                stage.pName = entry_points.emplace_back(stage.pName).c_str();
+                if (stage.pSpecializationInfo) {
+                    auto& source = *stage.pSpecializationInfo;
+                    auto& entries = specialization_entries.emplace_back(
+                        source.pMapEntries, 
+                        source.pMapEntries + source.mapEntryCount
+                    );
+                    auto bytes = 
+                        static_cast<const char*>(source.pData);
+                    auto& data = specialization_data.emplace_back(
+                        bytes, bytes + source.dataSize
+                    );
+                    auto& specialization = 
+                        specializations.emplace_back(source);
+                    specialization.pMapEntries = entries.data();
+                    specialization.pData = data.data();
+                    stage.pSpecializationInfo = &specialization;
+                }
+                stages.push_back(stage);
+            }
+            create_info.pStages = stages.data();
 
-    struct vector_hash {
-        typedef void is_transparent;
-        size_t operator()(const vector<uint64_t>& value) const {
-            return operator()(span<const uint64_t>(value.data(), value.size()));
+            if (info.pVertexInputState) {
+                auto& source = *info.pVertexInputState;
+                vertex_bindings.assign(
+                    source.pVertexBindingDescriptions, 
+                    source.pVertexBindingDescriptions + 
+                        source.vertexBindingDescriptionCount
+                );
+                vertex_attributes.assign(
+                    source.pVertexAttributeDescriptions,
+                    source.pVertexAttributeDescriptions +
+                        source.vertexAttributeDescriptionCount
+                );
+                vertex_input = source;
+                vertex_input.pVertexBindingDescriptions = 
+                    vertex_bindings.data();
+                vertex_input.pVertexAttributeDescriptions = 
+                    vertex_attributes.data();
+                create_info.pVertexInputState = &vertex_input;
+            }
+            if (info.pColorBlendState) {
+                auto& source = *info.pColorBlendState;
+                blend_attachments.assign(
+                    source.pAttachments, 
+                    source.pAttachments + source.attachmentCount
+                );
+                color_blend = source;
+                color_blend.pAttachments = blend_attachments.data();
+                create_info.pColorBlendState = &color_blend;
+            }
+            if (info.pDynamicState) {
+                auto& source = *info.pDynamicState;
+                dynamic_states.assign(
+                    source.pDynamicStates, 
+                    source.pDynamicStates + source.dynamicStateCount
+                );
+                dynamic = source;
+                dynamic.pDynamicStates = dynamic_states.data();
+                create_info.pDynamicState = &dynamic;
+            }
+            // viewport and scissor are dynamic, so only the counts matter
+            create_info.pViewportState = copy(info.pViewportState, viewport);
+            create_info.pInputAssemblyState = 
+                copy(info.pInputAssemblyState, input_assembly);
+            create_info.pTessellationState = 
+                copy(info.pTessellationState, tessellation);
+            create_info.pRasterizationState = 
+                copy(info.pRasterizationState, rasterization);
+            create_info.pMultisampleState = 
+                copy(info.pMultisampleState, multisample);
+            create_info.pDepthStencilState = 
+                copy(info.pDepthStencilState, depth_stencil);
+            if (auto source = rendering_create_info(info.pNext)) {
+                color_formats.assign(
+                    source->pColorAttachmentFormats,
+                    source->pColorAttachmentFormats + 
+                        source->colorAttachmentCount
+                );
+                rendering = *source;
+                rendering.pNext = nullptr;
+                rendering.pColorAttachmentFormats = color_formats.data();
+                create_info.pNext = &rendering;
+            }
+        }
+
+        // points into itself
+        pipeline_state(const pipeline_state&) = delete;
+        pipeline_state& operator=(const pipeline_state&) = delete;
+
+        template<class T>
+        static const T* copy(const T* source, T& target) {
+            if (!source)
+                return nullptr;
+            target = *source;
+            return &target;
         }
-        size_t operator()(span<const uint64_t> value) const {
-            // unfortunately, C++ doesn't offer hash<span>
-            size_t hash = 0;
-            for (auto element : value) {
-                hash = (hash * 820541279138450587ull) ^ element;
+
+        VkGraphicsPipelineCreateInfo create_info;
+        vector<shared_ptr<unique_shader_module>> shader_modules;
+        vector<VkPipelineShaderStageCreateInfo> stages;
+        deque<string> entry_points;
+        deque<VkSpecializationInfo> specializations;
+        deque<vector<VkSpecializationMapEntry>> specialization_entries;
+        deque<vector<char>> specialization_data;
+        VkPipelineVertexInputStateCreateInfo vertex_input;
+        vector<VkVertexInputBindingDescription> vertex_bindings;
+        vector<VkVertexInputAttributeDescription> vertex_attributes;
+        VkPipelineInputAssemblyStateCreateInfo input_assembly;
+        VkPipelineTessellationStateCreateInfo tessellation;
+        VkPipelineViewportStateCreateInfo viewport;
+        VkPipelineRasterizationStateCreateInfo rasterization;
+        VkPipelineMultisampleStateCreateInfo multisample;
+        VkPipelineDepthStencilStateCreateInfo depth_stencil;
+        VkPipelineColorBlendStateCreateInfo color_blend;
+        vector<VkPipelineColorBlendAttachmentState> blend_attachments;
+        VkPipelineDynamicStateCreateInfo dynamic;
+        vector<VkDynamicState> dynamic_states;
+        VkPipelineRenderingCreateInfoKHR rendering;
+        vector<VkFormat> color_formats;
+    };
+
+    // owns what a compute pipeline create info points to
+    struct compute_pipeline_state {
+        compute_pipeline_state(
+            const VkComputePipelineCreateInfo& info,
+            shared_ptr<unique_shader_module> module
+        ) : 
+            create_info(info), shader_module(std::move(module)), 
+            entry_point(info.stage.pName) 
+        {
+            create_info.stage.pName = entry_point.c_str();
+            if (info.stage.pSpecializationInfo) {
+                auto& source = *info.stage.pSpecializationInfo;
+                specialization_entries.assign(
+                    source.pMapEntries, 
+                    source.pMapEntries + source.mapEntryCount
+                );
+                auto bytes = static_cast<const char*>(source.pData);
+                specialization_data.assign(bytes, bytes + source.dataSize);
+                specialization = source;
+                specialization.pMapEntries = specialization_entries.data();
+                specialization.pData = specialization_data.data();
+                create_info.stage.pSpecializationInfo = &specialization;
             }
-            return hash;
         }
+
+        // points into itself
+        compute_pipeline_state(const compute_pipeline_state&) = delete;
+        compute_pipeline_state& operator=(
+            const compute_pipeline_state&
+        ) = delete;
+
+        VkComputePipelineCreateInfo create_info;
+        shared_ptr<unique_shader_module> shader_module;
+        string entry_point;
+        VkSpecializationInfo specialization;
+        vector<VkSpecializationMapEntry> specialization_entries;
+        vector<char> specialization_data;
+    };
+
+    // resource interface of a combination of shader stages, derived from 
+    // their reflection once
+    struct program {
+        vector<shader_binding> bindings;
+        VkPushConstantRange push_constant_range;
+        // size of the largest uniform block
+        VkDeviceSize uniform_size = 0;
+        // reads the uniform source from the first storage block instead, 
+        // as an array indexed by gl_DrawID in batched draws
+        bool draw_data = false;
+        VkDescriptorSetLayout descriptor_set_layout;
+        VkPipelineLayout pipeline_layout;
+        // null if the program has no descriptors
+        VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+    };
+
+    struct string_hash : std::hash<string_view> {
+        typedef void is_transparent;
+    };
+
+    // bump allocator for temporary arrays, so draw doesn't need to allocate 
+    // from the heap
+    struct arena {
+        arena(size_t capacity) : 
+            buffer(new std::byte[capacity]), 
+            resource(buffer.get(), capacity) {}
+
+        // invalidates all previous allocations
+        void reset() { resource.release(); }
+
+        pmr::memory_resource* get() { return &resource; }
+
+        unique_ptr<std::byte[]> buffer;
+        // falls back to the heap when the buffer is exhausted
+        pmr::monotonic_buffer_resource resource;
+    };
+
+    struct device_features {
+        bool extended_dynamic_state = false;
+        bool vertex_input_dynamic_state = false;
+        bool graphics_pipeline_library = false;
+        bool memory_budget = false;
+        bool timeline_semaphore = false;
+        bool multi_draw_indirect = false;
+        bool draw_indirect_count = false;
+        bool dynamic_rendering = false;
+    };
+
+    struct device_functions {
+        PFN_vkCmdSetPrimitiveTopologyEXT cmd_set_primitive_topology;
+        PFN_vkCmdSetVertexInputEXT cmd_set_vertex_input;
+        PFN_vkWaitSemaphoresKHR wait_semaphores;
+        PFN_vkGetSemaphoreCounterValueKHR get_semaphore_counter_value;
+        PFN_vkCmdDrawIndirectCountKHR cmd_draw_indirect_count;
+        PFN_vkCmdBeginRenderingKHR cmd_begin_rendering;
+        PFN_vkCmdEndRenderingKHR cmd_end_rendering;
     };
 
     struct renderer_data {
@@ -104,46 +625,111 @@ namespace imv {
         VkSurfaceKHR surface;
 
         size_t offset_alignment;
+        size_t storage_offset_alignment;
+        uint32_t max_push_constants_size;
+        uint32_t max_draw_indirect_count;
 
         unique_device device;
+        device_features features;
+        device_functions functions;
         VkQueue graphics_queue, present_queue;
         unique_command_pool command_pool;
+        // null without a transfer only queue family, uploads then run on 
+        // the graphics queue
+        VkQueue transfer_queue = VK_NULL_HANDLE;
+        unique_command_pool transfer_command_pool;
 
         unique_allocator allocator;
+        // textures are placed in large blocks of one memory type instead of
+        // an allocation each
+        unique_pool texture_pool;
 
         unique_render_pass render_pass;
+        // of the window, VK_FORMAT_UNDEFINED without depth attachment
+        VkFormat depth_format = VK_FORMAT_UNDEFINED;
+        // render passes of offscreen passes, keyed by their create info
+        flat_hash_map<unique_render_pass> render_passes;
 
-        unique_semaphore swapchain_image_ready_semaphore;
+        VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+        uint32_t frames_in_flight;
+
+        VkDeviceSize texture_budget;
+        uint32_t texture_eviction_frames;
+        // size of all textures in image_cache
+        VkDeviceSize texture_memory = 0;
+        vector<texture_upload> pending_uploads;
 
         uint32_t graphics_queue_family = ~0u, present_queue_family = ~0u;
+        uint32_t transfer_queue_family = ~0u;
         VkSurfaceFormatKHR surface_format;
         VkPhysicalDeviceMemoryProperties memory_properties;
 
-        vector<VkPipelineShaderStageCreateInfo> pipeline_shader_stages;
+        arena scratch{64 * 1024};
 
         unordered_map<
             string, shader_module_file, string_hash, equal_to<>
         > shader_cache;
+        // keyed by a hash of the SPIR-V words, so files with the same code
+        // share a module and the pipelines using it
+        flat_hash_map<shader_code> shader_codes;
+        // built into the library, created on first use
+        shader_code frustum_cull;
 
-        unique_ktx_device ktx_device;
-        
         unordered_map<
             string, image_file, string_hash, equal_to<>
         > image_cache;
-        
         unordered_map<
-            vector<uint64_t>,
-            pipeline, vector_hash, equal_to<>
-        > pipeline_layouts;
-
+            string, render_target, string_hash, equal_to<>
+        > render_targets;
+        // of offscreen passes without dynamic rendering, keyed by render 
+        // pass, extent and attachment views
+        flat_hash_map<unique_framebuffer> framebuffers;
         unordered_map<
-            vector<uint64_t>,
-            unique_descriptor_pool, vector_hash, equal_to<>
-        > descriptor_pools;
+            string, storage_buffer, string_hash, equal_to<>
+        > storage_buffers;
+        
+        flat_hash_map<pipeline> pipeline_layouts;
+
+        flat_hash_map<program> programs;
+
+        flat_hash_map<unique_sampler> samplers;
+
+        flat_hash_map<unique_descriptor_pool> descriptor_pools;
+
+        // ready once compiled, possibly on one of the compile threads
+        flat_hash_map<shared_future<unique_pipeline>> pipelines;
+
+        // parts of pipelines keyed by the state they depend on, and the
+        // pipelines linked from them while the optimized ones compile
+        flat_hash_map<shared_future<unique_pipeline>> pipeline_libraries;
+        flat_hash_map<unique_pipeline> linked_pipelines;
 
         unique_pipeline_cache pipeline_cache;
 
-        view view;
+        shared_ptr<imv::view> view;
+
+        // counts submitted frames, signaling their frame_number
+        unique_semaphore timeline;
+        // objects released once the timeline reaches their value
+        deque<pair<uint64_t, shared_ptr<const void>>> retired;
+
+        unique_ptr<frame[]> frames;
+        uint32_t frame_index = 0;
+        uint64_t frame_number = 0;
+        bool recording = false;
+
+        // destroyed before everything the compiles use
+        unique_ptr<thread_pool> compile_threads;
+
+        // set if calls are queued for the render thread
+        unique_ptr<spsc_ring> queue;
+        queue_policy queue_full;
+        // the first error of the render thread, rethrown by the next call
+        // at a frame boundary
+        mutex render_error_mutex;
+        exception_ptr render_error;
+        atomic<bool> render_failed = false;
+        jthread render_thread;
     };
 
     struct file_deleter {
@@ -164,36 +750,175 @@ namespace imv {
         return content;
     }
 
-    renderer::renderer(
-        VkInstance instance, VkSurfaceKHR surface
-    ) {        
-        // look for available devices
-        VkPhysicalDevice physical_device;
+    bool device_extension_supported(
+        VkPhysicalDevice physical_device, const char* name
+    ) {
+        uint32_t extension_count = 0;
+        check(vkEnumerateDeviceExtensionProperties(
+            physical_device, nullptr, &extension_count, nullptr
+        ));
+        vector<VkExtensionProperties> extensions(extension_count);
+        check(vkEnumerateDeviceExtensionProperties(
+            physical_device, nullptr, &extension_count, extensions.data()
+        ));
+        return ranges::any_of(extensions, [&](const auto& extension) {
+            return strcmp(extension.extensionName, name) == 0;
+        });
+    }
 
+    // devices that can't present to the surface or pace frames with a 
+    // timeline semaphore are skipped, the others are ranked by type, then 
+    // by device local memory, then by queues that run next to rendering
+    VkPhysicalDevice select_physical_device(
+        VkInstance instance, VkSurfaceKHR surface, const renderer_info& info
+    ) {
         uint32_t device_count = 0;
-        imv::check(vkEnumeratePhysicalDevices(
-            instance, &device_count, nullptr
-        ));
+        check(vkEnumeratePhysicalDevices(instance, &device_count, nullptr));
         if (device_count == 0) {
             throw std::runtime_error("no Vulkan capable GPU found");
         }
-        {
-            auto devices = std::make_unique<VkPhysicalDevice[]>(device_count);
-            imv::check(vkEnumeratePhysicalDevices(
-                instance, &device_count, devices.get()
-            ));
-            // TODO: check for VK_KHR_swapchain support
-            physical_device = devices[0]; // just pick the first one for now
+        vector<VkPhysicalDevice> devices(device_count);
+        check(vkEnumeratePhysicalDevices(
+            instance, &device_count, devices.data()
+        ));
+
+        VkPhysicalDevice selected = VK_NULL_HANDLE;
+        tuple<int, VkDeviceSize, int> selected_score;
+        for (auto device : devices) {
+            VkPhysicalDeviceIDProperties id_properties{
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES,
+            };
+            VkPhysicalDeviceProperties2 properties{
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+                .pNext = &id_properties,
+            };
+            vkGetPhysicalDeviceProperties2(device, &properties);
+
+            if (
+                !info.device_name.empty() && 
+                string_view(properties.properties.deviceName).find(
+                    info.device_name
+                ) == string_view::npos
+            ) {
+                continue;
+            }
+            if (
+                info.device_uuid && 
+                !ranges::equal(*info.device_uuid, id_properties.deviceUUID)
+            ) {
+                continue;
+            }
+            if (!device_extension_supported(
+                device, VK_KHR_SWAPCHAIN_EXTENSION_NAME
+            )) {
+                continue;
+            }
+            VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_features{
+                .sType = 
+                    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR,
+            };
+            VkPhysicalDeviceFeatures2 features{
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+                .pNext = &timeline_features,
+            };
+            vkGetPhysicalDeviceFeatures2(device, &features);
+            if (
+                !device_extension_supported(
+                    device, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME
+                ) || 
+                !timeline_features.timelineSemaphore
+            ) {
+                continue;
+            }
+
+            uint32_t queue_family_count = 0;
+            vkGetPhysicalDeviceQueueFamilyProperties(
+                device, &queue_family_count, nullptr
+            );
+            vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+            vkGetPhysicalDeviceQueueFamilyProperties(
+                device, &queue_family_count, queue_families.data()
+            );
+            bool graphics = false, present = false;
+            int side_queues = 0;
+            for (auto i = 0u; i < queue_family_count; i++) {
+                auto flags = queue_families[i].queueFlags;
+                graphics |= bool(flags & VK_QUEUE_GRAPHICS_BIT);
+                VkBool32 present_support = false;
+                vkGetPhysicalDeviceSurfaceSupportKHR(
+                    device, i, surface, &present_support
+                );
+                present |= bool(present_support);
+                if (!(flags & VK_QUEUE_GRAPHICS_BIT))
+                    side_queues++;
+            }
+            if (!graphics || !present)
+                continue;
+
+            VkPhysicalDeviceMemoryProperties memory_properties;
+            vkGetPhysicalDeviceMemoryProperties(device, &memory_properties);
+            VkDeviceSize local_memory = 0;
+            for (auto i = 0u; i < memory_properties.memoryHeapCount; i++) {
+                auto& heap = memory_properties.memoryHeaps[i];
+                if (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+                    local_memory += heap.size;
+            }
+
+            int type_rank = 0;
+            switch (properties.properties.deviceType) {
+            case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: type_rank = 4; break;
+            case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: type_rank = 3; break;
+            case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: type_rank = 2; break;
+            case VK_PHYSICAL_DEVICE_TYPE_CPU: type_rank = 1; break;
+            default: break;
+            }
+
+            tuple score{ type_rank, local_memory, side_queues };
+            if (!selected || score > selected_score) {
+                selected = device;
+                selected_score = score;
+            }
+        }
+        if (!selected) {
+            throw std::runtime_error(
+                info.device_name.empty() && !info.device_uuid ?
+                    "no GPU can present to the surface with timeline "
+                    "semaphores" :
+                    "the requested GPU can't present to the surface with "
+                    "timeline semaphores"
+            );
         }
+        return selected;
+    }
+
+    // the render thread runs the calls queued by other threads
+    void run_render_thread(renderer_data& r);
+    void stop_render_thread(renderer_data& r);
+    void flush_batch(renderer_data& r, imv::frame& frame, imv::pass& pass);
+
+    renderer::renderer(
+        VkInstance instance, VkSurfaceKHR surface, const renderer_info& info
+    ) {        
+        VkPhysicalDevice physical_device = 
+            select_physical_device(instance, surface, info);
 
         d = make_unique<renderer_data>();
         d->physical_device = physical_device;
         d->surface = surface;
+        d->frames_in_flight = std::max(info.frames_in_flight, 1u);
+        d->texture_budget = info.texture_budget;
+        d->depth_format = info.depth_format;
+        d->texture_eviction_frames = 
+            std::max(info.texture_eviction_frames, 1u);
         auto &r = *d;
 
         VkPhysicalDeviceProperties properties;
         vkGetPhysicalDeviceProperties(physical_device, &properties);
         d->offset_alignment = properties.limits.minUniformBufferOffsetAlignment;
+        d->storage_offset_alignment = 
+            properties.limits.minStorageBufferOffsetAlignment;
+        d->max_push_constants_size = properties.limits.maxPushConstantsSize;
+        d->max_draw_indirect_count = properties.limits.maxDrawIndirectCount;
 
         // look for available queue families
         uint32_t queue_family_count = 0;
@@ -219,73 +944,365 @@ namespace imv {
             if (present_support) {
                 r.present_queue_family = i;
             }
+
+            // usually backed by DMA engines, running next to rendering
+            auto transfer_only = 
+                (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+                !(queueFamily.queueFlags & 
+                    (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
+            if (transfer_only && r.transfer_queue_family == ~0u) {
+                r.transfer_queue_family = i;
+            }
         }
         if (r.graphics_queue_family == ~0u) {
             throw std::runtime_error("no suitable queue found");
         }
 
 
-        // create logical device
-        {
-            float priority = 1.0f;
-            VkDeviceQueueCreateInfo queue_create_infos[]{
-                {
-                    .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-                    .queueFamilyIndex = r.graphics_queue_family,
-                    .queueCount = 1,
-                    .pQueuePriorities = &priority,
-                }, {
-                    .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-                    .queueFamilyIndex = r.present_queue_family,
-                    .queueCount = 1,
-                    .pQueuePriorities = &priority,
-                }
-            };
+        // look for optional extensions
+        uint32_t extension_count = 0;
+        check(vkEnumerateDeviceExtensionProperties(
+            physical_device, nullptr, &extension_count, nullptr
+        ));
+        auto extensions = 
+            std::make_unique<VkExtensionProperties[]>(extension_count);
+        check(vkEnumerateDeviceExtensionProperties(
+            physical_device, nullptr, &extension_count, extensions.get()
+        ));
+        auto extension_supported = [&](const char* name) {
+            for (auto i = 0u; i < extension_count; i++) {
+                if (strcmp(extensions[i].extensionName, name) == 0)
+                    return true;
+            }
+            return false;
+        };
 
-            const char* enabled_extension_names[] = {
-                VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-            };
+        VkPhysicalDeviceExtendedDynamicStateFeaturesEXT 
+        extended_dynamic_state_features{
+            .sType = 
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT,
+        };
+        VkPhysicalDeviceVertexInputDynamicStateFeaturesEXT 
+        vertex_input_dynamic_state_features{
+            .sType = 
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VERTEX_INPUT_DYNAMIC_STATE_FEATURES_EXT,
+            .pNext = &extended_dynamic_state_features,
+        };
+        VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT 
+        graphics_pipeline_library_features{
+            .sType = 
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT,
+            .pNext = &vertex_input_dynamic_state_features,
+        };
+        VkPhysicalDeviceDynamicRenderingFeaturesKHR 
+        dynamic_rendering_features{
+            .sType = 
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+            .pNext = &graphics_pipeline_library_features,
+        };
+        VkPhysicalDeviceTimelineSemaphoreFeaturesKHR 
+        timeline_semaphore_features{
+            .sType = 
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR,
+            .pNext = &dynamic_rendering_features,
+        };
+        VkPhysicalDeviceFeatures2 supported_features{
+            .sType = 
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+            .pNext = &timeline_semaphore_features,
+        };
+        vkGetPhysicalDeviceFeatures2(physical_device, &supported_features);
 
-            VkPhysicalDeviceFeatures device_features{};
-            VkDeviceCreateInfo create_info{
-                .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-                .queueCreateInfoCount = std::size(queue_create_infos),
-                .pQueueCreateInfos = queue_create_infos,
-                .enabledExtensionCount = std::size(enabled_extension_names),
-                .ppEnabledExtensionNames = enabled_extension_names,
-                .pEnabledFeatures = &device_features
-            };
+        vector<const char*> enabled_extension_names = {
+            VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+        };
+        // chain of feature structures passed to vkCreateDevice
+        void* enabled_features = nullptr;
+        auto enable = [&](const char* name, auto& features) {
+            enabled_extension_names.push_back(name);
+            features.pNext = enabled_features;
+            enabled_features = &features;
+        };
 
-            check(vkCreateDevice(
-                r.physical_device, &create_info, nullptr, out_ptr(r.device)
-            ));
+        r.features.extended_dynamic_state = 
+            extension_supported(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME) &&
+            extended_dynamic_state_features.extendedDynamicState;
+        VkPhysicalDeviceExtendedDynamicStateFeaturesEXT 
+        enabled_extended_dynamic_state{
+            .sType = 
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT,
+            .extendedDynamicState = VK_TRUE,
+        };
+        if (r.features.extended_dynamic_state) {
+            enable(
+                VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME, 
+                enabled_extended_dynamic_state
+            );
         }
-        current_device = r.device.get();
-
-        // retrieve queues
-        vkGetDeviceQueue(
-            r.device.get(), r.graphics_queue_family, 0, &r.graphics_queue
-        );
-        vkGetDeviceQueue(
-            r.device.get(), r.present_queue_family, 0, &r.present_queue
-        );
 
-        // create allocator
-        {
-            VmaVulkanFunctions vulkan_functions = {
-                .vkGetInstanceProcAddr = &vkGetInstanceProcAddr,
-                .vkGetDeviceProcAddr = &vkGetDeviceProcAddr,
-            };
+        r.features.vertex_input_dynamic_state = 
+            extension_supported(
+                VK_EXT_VERTEX_INPUT_DYNAMIC_STATE_EXTENSION_NAME
+            ) &&
+            vertex_input_dynamic_state_features.vertexInputDynamicState;
+        VkPhysicalDeviceVertexInputDynamicStateFeaturesEXT 
+        enabled_vertex_input_dynamic_state{
+            .sType = 
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VERTEX_INPUT_DYNAMIC_STATE_FEATURES_EXT,
+            .vertexInputDynamicState = VK_TRUE,
+        };
+        if (r.features.vertex_input_dynamic_state) {
+            enable(
+                VK_EXT_VERTEX_INPUT_DYNAMIC_STATE_EXTENSION_NAME, 
+                enabled_vertex_input_dynamic_state
+            );
+        }
 
-            VmaAllocatorCreateInfo create_info = {
+        r.features.graphics_pipeline_library = 
+            extension_supported(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) &&
+            extension_supported(
+                VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME
+            ) &&
+            graphics_pipeline_library_features.graphicsPipelineLibrary;
+        VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT 
+        enabled_graphics_pipeline_library{
+            .sType = 
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT,
+            .graphicsPipelineLibrary = VK_TRUE,
+        };
+        if (r.features.graphics_pipeline_library) {
+            enabled_extension_names.push_back(
+                VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME
+            );
+            enable(
+                VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME, 
+                enabled_graphics_pipeline_library
+            );
+        }
+
+        // frames are paced with a timeline semaphore
+        r.features.timeline_semaphore = 
+            extension_supported(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) &&
+            timeline_semaphore_features.timelineSemaphore;
+        if (!r.features.timeline_semaphore) {
+            throw std::runtime_error("timeline semaphores not supported");
+        }
+        VkPhysicalDeviceTimelineSemaphoreFeaturesKHR 
+        enabled_timeline_semaphore{
+            .sType = 
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR,
+            .timelineSemaphore = VK_TRUE,
+        };
+        enable(
+            VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME, 
+            enabled_timeline_semaphore
+        );
+
+        r.features.memory_budget = 
+            extension_supported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        if (r.features.memory_budget) {
+            enabled_extension_names.push_back(
+                VK_EXT_MEMORY_BUDGET_EXTENSION_NAME
+            );
+        }
+
+        // pipelines only depend on the formats of the attachments instead 
+        // of render passes, and passes need no framebuffers
+        r.features.dynamic_rendering = 
+            extension_supported(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME) &&
+            extension_supported(
+                VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME
+            ) &&
+            extension_supported(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME) &&
+            dynamic_rendering_features.dynamicRendering;
+        VkPhysicalDeviceDynamicRenderingFeaturesKHR 
+        enabled_dynamic_rendering{
+            .sType = 
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+            .dynamicRendering = VK_TRUE,
+        };
+        if (r.features.dynamic_rendering) {
+            // dependencies of dynamic rendering in Vulkan 1.1
+            enabled_extension_names.push_back(
+                VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME
+            );
+            enabled_extension_names.push_back(
+                VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME
+            );
+            enable(
+                VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME, 
+                enabled_dynamic_rendering
+            );
+        }
+
+        // batches need more than one draw per indirect draw call
+        r.features.multi_draw_indirect = 
+            supported_features.features.multiDrawIndirect;
+        r.features.draw_indirect_count = 
+            extension_supported(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        if (r.features.draw_indirect_count) {
+            enabled_extension_names.push_back(
+                VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME
+            );
+        }
+
+        // create logical device
+        {
+            float priority = 1.0f;
+            // each family may only be requested once
+            vector<VkDeviceQueueCreateInfo> queue_create_infos;
+            auto families = { 
+                r.graphics_queue_family, r.present_queue_family,
+                r.transfer_queue_family,
+            };
+            for (auto family : families) {
+                if (
+                    family == ~0u || 
+                    ranges::contains(
+                        queue_create_infos, family,
+                        &VkDeviceQueueCreateInfo::queueFamilyIndex
+                    )
+                ) {
+                    continue;
+                }
+                queue_create_infos.push_back({
+                    .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                    .queueFamilyIndex = family,
+                    .queueCount = 1,
+                    .pQueuePriorities = &priority,
+                });
+            }
+
+            VkPhysicalDeviceFeatures device_features{
+                .multiDrawIndirect = r.features.multi_draw_indirect,
+            };
+            VkDeviceCreateInfo create_info{
+                .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+                .pNext = enabled_features,
+                .queueCreateInfoCount = uint32_t(queue_create_infos.size()),
+                .pQueueCreateInfos = queue_create_infos.data(),
+                .enabledExtensionCount = 
+                    uint32_t(enabled_extension_names.size()),
+                .ppEnabledExtensionNames = enabled_extension_names.data(),
+                .pEnabledFeatures = &device_features
+            };
+
+            check(vkCreateDevice(
+                r.physical_device, &create_info, nullptr, out_ptr(r.device)
+            ));
+        }
+
+        // extension functions are not exported by the loader
+        if (r.features.extended_dynamic_state) {
+            r.functions.cmd_set_primitive_topology = 
+                reinterpret_cast<PFN_vkCmdSetPrimitiveTopologyEXT>(
+                    vkGetDeviceProcAddr(
+                        r.device.get(), "vkCmdSetPrimitiveTopologyEXT"
+                    )
+                );
+        }
+        if (r.features.vertex_input_dynamic_state) {
+            r.functions.cmd_set_vertex_input = 
+                reinterpret_cast<PFN_vkCmdSetVertexInputEXT>(
+                    vkGetDeviceProcAddr(
+                        r.device.get(), "vkCmdSetVertexInputEXT"
+                    )
+                );
+        }
+        if (r.features.draw_indirect_count) {
+            r.functions.cmd_draw_indirect_count = 
+                reinterpret_cast<PFN_vkCmdDrawIndirectCountKHR>(
+                    vkGetDeviceProcAddr(
+                        r.device.get(), "vkCmdDrawIndirectCountKHR"
+                    )
+                );
+        }
+        if (r.features.dynamic_rendering) {
+            r.functions.cmd_begin_rendering = 
+                reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(
+                    vkGetDeviceProcAddr(
+                        r.device.get(), "vkCmdBeginRenderingKHR"
+                    )
+                );
+            r.functions.cmd_end_rendering = 
+                reinterpret_cast<PFN_vkCmdEndRenderingKHR>(
+                    vkGetDeviceProcAddr(r.device.get(), "vkCmdEndRenderingKHR")
+                );
+        }
+        r.functions.wait_semaphores = 
+            reinterpret_cast<PFN_vkWaitSemaphoresKHR>(
+                vkGetDeviceProcAddr(r.device.get(), "vkWaitSemaphoresKHR")
+            );
+        r.functions.get_semaphore_counter_value = 
+            reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(
+                vkGetDeviceProcAddr(
+                    r.device.get(), "vkGetSemaphoreCounterValueKHR"
+                )
+            );
+
+        // retrieve queues
+        vkGetDeviceQueue(
+            r.device.get(), r.graphics_queue_family, 0, &r.graphics_queue
+        );
+        vkGetDeviceQueue(
+            r.device.get(), r.present_queue_family, 0, &r.present_queue
+        );
+        if (r.transfer_queue_family != ~0u) {
+            vkGetDeviceQueue(
+                r.device.get(), r.transfer_queue_family, 0, &r.transfer_queue
+            );
+        }
+
+        // create allocator
+        {
+            VmaVulkanFunctions vulkan_functions = {
+                .vkGetInstanceProcAddr = &vkGetInstanceProcAddr,
+                .vkGetDeviceProcAddr = &vkGetDeviceProcAddr,
+            };
+
+            VmaAllocatorCreateInfo create_info = {
+                .flags = r.features.memory_budget ? 
+                    VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT : 0u,
                 .physicalDevice = physical_device,
                 .device = r.device.get(),
                 .pVulkanFunctions = &vulkan_functions,
                 .instance = instance,
-                .vulkanApiVersion = VK_API_VERSION_1_0,
+                // memory budgets are queried with 1.1 functions
+                .vulkanApiVersion = VK_API_VERSION_1_1,
             };
             check(vmaCreateAllocator(&create_info, out_ptr(r.allocator)));
-            current_allocator = r.allocator.get();
+        }
+
+        // sampled images of any color format usually share a memory type,
+        // so one is picked for a typical texture
+        {
+            VkImageCreateInfo image_info = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                .imageType = VK_IMAGE_TYPE_2D,
+                .format = VK_FORMAT_BC7_SRGB_BLOCK,
+                .extent = { 1024, 1024, 1 },
+                .mipLevels = 1,
+                .arrayLayers = 1,
+                .samples = VK_SAMPLE_COUNT_1_BIT,
+                .tiling = VK_IMAGE_TILING_OPTIMAL,
+                .usage = 
+                    VK_IMAGE_USAGE_SAMPLED_BIT | 
+                    VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            };
+            VmaAllocationCreateInfo allocation_info = {
+                .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            };
+            VmaPoolCreateInfo create_info = {};
+            check(vmaFindMemoryTypeIndexForImageInfo(
+                r.allocator.get(), &image_info, &allocation_info, 
+                &create_info.memoryTypeIndex
+            ));
+            check(vmaCreatePool(
+                r.allocator.get(), &create_info, 
+                owned_out_ptr(r.texture_pool, r.allocator.get())
+            ));
         }
 
         // create swap chains
@@ -324,6 +1341,12 @@ namespace imv {
             }
         }
 
+        for (auto i = 0u; i < present_mode_count; i++) {
+            if (present_modes[i] == info.present_mode) {
+                r.present_mode = info.present_mode;
+            }
+        }
+
         {
             VkCommandPoolCreateInfo create_info{
                 .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
@@ -331,16 +1354,40 @@ namespace imv {
                 .queueFamilyIndex = r.graphics_queue_family,
             };
             check(vkCreateCommandPool(
-                r.device.get(), &create_info, nullptr, out_ptr(r.command_pool)
+                r.device.get(), &create_info, nullptr, 
+                owned_out_ptr(r.command_pool, r.device.get())
             ));
+            if (r.transfer_queue) {
+                create_info.queueFamilyIndex = r.transfer_queue_family;
+                check(vkCreateCommandPool(
+                    r.device.get(), &create_info, nullptr, 
+                    owned_out_ptr(r.transfer_command_pool, r.device.get())
+                ));
+            }
         }
 
         vkGetPhysicalDeviceMemoryProperties(
             r.physical_device, &r.memory_properties
         );
 
-        {
-            auto attachments = {
+        if (r.depth_format != VK_FORMAT_UNDEFINED) {
+            VkFormatProperties properties;
+            vkGetPhysicalDeviceFormatProperties(
+                r.physical_device, r.depth_format, &properties
+            );
+            if (
+                !(properties.optimalTilingFeatures & 
+                    VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+            ) {
+                throw std::runtime_error("depth format not supported");
+            }
+        }
+
+        // the window's render pass, replaced by formats with dynamic 
+        // rendering
+        if (!r.features.dynamic_rendering) {
+            bool depth = r.depth_format != VK_FORMAT_UNDEFINED;
+            vector<VkAttachmentDescription> attachments = {
                 VkAttachmentDescription{
                     .format = r.surface_format.format,
                     .samples = VK_SAMPLE_COUNT_1_BIT,
@@ -352,36 +1399,63 @@ namespace imv {
                     .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
                 },
             };
+            if (depth) {
+                // only used within the frame, so it is never stored
+                attachments.push_back({
+                    .format = r.depth_format,
+                    .samples = VK_SAMPLE_COUNT_1_BIT,
+                    .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                    .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                    .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                    .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                    .finalLayout = 
+                        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                });
+            }
             auto attachment_references = {
                 VkAttachmentReference{
                     .attachment = 0,
                     .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
                 },
             };
+            VkAttachmentReference depth_reference = {
+                .attachment = 1,
+                .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            };
             auto subpasses = {
                 VkSubpassDescription{
                     .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
                     .colorAttachmentCount =
                         static_cast<uint32_t>(attachment_references.size()),
                     .pColorAttachments = attachment_references.begin(),
+                    .pDepthStencilAttachment = 
+                        depth ? &depth_reference : nullptr,
                 },
             };
+            // the depth image of a swapchain image is reused by the next
+            // frame drawing to it
             auto subpass_dependencies = {
                 VkSubpassDependency{
                     .srcSubpass = VK_SUBPASS_EXTERNAL,
                     .dstSubpass = 0,
                     .srcStageMask = 
-                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
                     .dstStageMask = 
-                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                    .srcAccessMask = 0,
-                    .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+                    .srcAccessMask = 
+                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    .dstAccessMask = 
+                        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
                 },
             };
             VkRenderPassCreateInfo create_info = {
                 .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
                 .attachmentCount = static_cast<uint32_t>(attachments.size()),
-                .pAttachments = attachments.begin(),
+                .pAttachments = attachments.data(),
                 .subpassCount = static_cast<uint32_t>(subpasses.size()),
                 .pSubpasses = subpasses.begin(),
                 .dependencyCount =
@@ -389,37 +1463,56 @@ namespace imv {
                 .pDependencies = subpass_dependencies.begin(),
             };
             check(vkCreateRenderPass(
-                r.device.get(), &create_info, nullptr, out_ptr(r.render_pass)
+                r.device.get(), &create_info, nullptr, 
+                owned_out_ptr(r.render_pass, r.device.get())
             ));
         }
 
         {
+            VkPipelineCacheCreateInfo create_info{
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+            };
+            vkCreatePipelineCache(
+                r.device.get(), &create_info, nullptr, 
+                owned_out_ptr(r.pipeline_cache, r.device.get())
+            );
+        }
+
+        {
+            VkSemaphoreTypeCreateInfoKHR type_create_info = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR,
+                .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR,
+                .initialValue = 0,
+            };
             VkSemaphoreCreateInfo create_info = {
                 .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                .pNext = &type_create_info,
             };
             check(vkCreateSemaphore(
-                r.device.get(), &create_info, nullptr,
-                out_ptr(r.swapchain_image_ready_semaphore)
+                r.device.get(), &create_info, nullptr, 
+                owned_out_ptr(r.timeline, r.device.get())
             ));
         }
 
-        r.ktx_device.reset(new ktxVulkanDeviceInfo);
-        check(ktxVulkanDeviceInfo_Construct(
-            r.ktx_device.get(), physical_device, r.device.get(), 
-            r.graphics_queue, r.command_pool.get(), nullptr
-        ));
+        unsigned compile_threads = info.compile_threads;
+        if (compile_threads == 0)
+            compile_threads = std::max(thread::hardware_concurrency(), 2u) - 1;
+        r.compile_threads = make_unique<thread_pool>(compile_threads);
 
-        {
-            VkPipelineCacheCreateInfo create_info{
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
-            };
-            vkCreatePipelineCache(
-                r.device.get(), &create_info, nullptr, out_ptr(r.pipeline_cache)
-            );
+        if (info.render_thread) {
+            r.queue = make_unique<spsc_ring>(info.queue_capacity);
+            r.queue_full = info.queue_full;
+            r.render_thread = jthread([&r] { run_render_thread(r); });
         }
     }
 
     renderer::~renderer() {
+        // the render thread finishes the queued calls first
+        if (d && d->queue)
+            stop_render_thread(*d);
+        // nothing waits for the GPU when it is destroyed
+        if (d)
+            vkDeviceWaitIdle(d->device.get());
     }
 
     renderer& get(renderer* renderer) {
@@ -428,371 +1521,1107 @@ namespace imv {
         return *renderer;
     }
 
-    void wait_frame(renderer* renderer) {
-        renderer_data& r = *get(renderer).d;
-        auto& view = r.view;
+    shared_ptr<view> create_view(renderer_data& r, imv::view* old) {
+        // only the swapchain, its image views and framebuffers are recreated,
+        // per-frame resources are kept
+        auto result = make_shared<view>();
+        auto& v = *result;
 
-        if (!view.swapchain) {
-            check(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
-                r.physical_device, r.surface, &view.capabilities
-            ));
+        check(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
+            r.physical_device, r.surface, &v.capabilities
+        ));
 
-            unsigned width = view.capabilities.currentExtent.width;
-            unsigned height = view.capabilities.currentExtent.height;
+        unsigned width = v.capabilities.currentExtent.width;
+        unsigned height = v.capabilities.currentExtent.height;
+        if (width == 0 || height == 0) {
+            // window is minimized
+            return nullptr;
+        }
 
-            view.extent = {
-                std::max(
-                    std::min<uint32_t>(
-                        width, view.capabilities.maxImageExtent.width
-                    ),
-                    view.capabilities.minImageExtent.width
+        v.extent = {
+            std::max(
+                std::min<uint32_t>(
+                    width, v.capabilities.maxImageExtent.width
                 ),
-                std::max(
-                    std::min<uint32_t>(
-                        height, view.capabilities.maxImageExtent.height
-                    ),
-                    view.capabilities.minImageExtent.height
-                )
+                v.capabilities.minImageExtent.width
+            ),
+            std::max(
+                std::min<uint32_t>(
+                    height, v.capabilities.maxImageExtent.height
+                ),
+                v.capabilities.minImageExtent.height
+            )
+        };
+
+        {
+            uint32_t queue_family_indices[]{
+                r.graphics_queue_family, r.present_queue_family
             };
+            VkSwapchainCreateInfoKHR create_info{
+                .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+                .surface = r.surface,
+                .minImageCount = max(
+                    min(3u, v.capabilities.maxImageCount), 
+                    v.capabilities.minImageCount
+                ),
+                .imageFormat = r.surface_format.format,
+                .imageColorSpace = r.surface_format.colorSpace,
+                .imageExtent = v.extent,
+                .imageArrayLayers = 1,
+                .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+                .imageSharingMode = VK_SHARING_MODE_CONCURRENT,
+                .queueFamilyIndexCount = std::size(queue_family_indices),
+                .pQueueFamilyIndices = queue_family_indices,
+                .preTransform = v.capabilities.currentTransform,
+                .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+                .presentMode = r.present_mode,
+                .clipped = VK_TRUE,
+                .oldSwapchain = old ? old->swapchain.get() : VK_NULL_HANDLE,
+            };
+            check(vkCreateSwapchainKHR(
+                r.device.get(), &create_info, nullptr, 
+                owned_out_ptr(v.swapchain, r.device.get())
+            ));
+        }
 
-            {
-                uint32_t queue_family_indices[]{
-                    r.graphics_queue_family, r.present_queue_family
-                };
-                VkSwapchainCreateInfoKHR create_info{
-                    .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-                    .surface = r.surface,
-                    .minImageCount = max(
-                        min(3u, view.capabilities.maxImageCount), 
-                        view.capabilities.minImageCount
-                    ),
-                    .imageFormat = r.surface_format.format,
-                    .imageColorSpace = r.surface_format.colorSpace,
-                    .imageExtent = view.extent,
-                    .imageArrayLayers = 1,
-                    .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-                    .imageSharingMode = VK_SHARING_MODE_CONCURRENT,
-                    .queueFamilyIndexCount = std::size(queue_family_indices),
-                    .pQueueFamilyIndices = queue_family_indices,
-                    .preTransform = view.capabilities.currentTransform,
-                    .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-                    // fifo has the widest support
-                    .presentMode = VK_PRESENT_MODE_FIFO_KHR,
-                    .clipped = VK_TRUE,
-                    .oldSwapchain = VK_NULL_HANDLE,
-                };
-                check(vkCreateSwapchainKHR(
-                    r.device.get(), &create_info, nullptr, 
-                    out_ptr(view.swapchain)
-                ));
-            }
+        check(vkGetSwapchainImagesKHR(
+            r.device.get(), v.swapchain.get(), &v.image_count, nullptr
+        ));
 
-            check(vkGetSwapchainImagesKHR(
-                r.device.get(), view.swapchain.get(), &view.image_count, nullptr
-            ));
+        v.swapchain_images = make_unique<VkImage[]>(v.image_count);
+        v.images = make_unique<image[]>(v.image_count);
 
-            view.swapchain_images = make_unique<VkImage[]>(view.image_count);
-            view.images = make_unique<image[]>(view.image_count);
+        check(vkGetSwapchainImagesKHR(
+            r.device.get(), v.swapchain.get(), &v.image_count, 
+            v.swapchain_images.get()
+        ));
 
-            check(vkGetSwapchainImagesKHR(
-                r.device.get(), view.swapchain.get(), &view.image_count, 
-                view.swapchain_images.get()
-            ));
+        return result;
+    }
+
+    // keeps the object alive until the frame being recorded finished, 
+    // which is the last one that can use it
+    void retire(renderer_data& r, shared_ptr<const void> object) {
+        if (object)
+            r.retired.emplace_back(r.frame_number, std::move(object));
+    }
+
+    void release_retired(renderer_data& r) {
+        uint64_t completed;
+        check(r.functions.get_semaphore_counter_value(
+            r.device.get(), r.timeline.get(), &completed
+        ));
+        while (!r.retired.empty() && r.retired.front().first <= completed)
+            r.retired.pop_front();
+    }
+
+    // releases the texture in the order it was created in
+    void retire(renderer_data& r, image_file& image) {
+        retire(r, std::move(image.view));
+        retire(r, std::move(image.image));
+        retire(r, std::move(image.allocation));
+    }
+
+    // bytes of textures to evict, from the configured budget or from the 
+    // budget of the device local heaps
+    VkDeviceSize texture_excess(renderer_data& r) {
+        if (r.texture_budget > 0) {
+            return r.texture_memory > r.texture_budget ? 
+                r.texture_memory - r.texture_budget : 0;
         }
+        if (!r.features.memory_budget)
+            return 0;
+        VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+        vmaGetHeapBudgets(r.allocator.get(), budgets);
+        VkDeviceSize excess = 0;
+        for (auto i = 0u; i < r.memory_properties.memoryHeapCount; i++) {
+            auto& heap = r.memory_properties.memoryHeaps[i];
+            if (!(heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+                continue;
+            if (budgets[i].usage > budgets[i].budget)
+                excess += budgets[i].usage - budgets[i].budget;
+        }
+        return std::min(excess, r.texture_memory);
+    }
 
-        VkResult result = vkAcquireNextImageKHR(
-            r.device.get(), view.swapchain.get(), ~0ul,
-            r.swapchain_image_ready_semaphore.get(),
-            VK_NULL_HANDLE, &view.image_index
-        );
-        if (result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR) {
-            std::exchange(view, {});
+    // drops the least recently used textures that weren't used for a while
+    void evict_textures(renderer_data& r) {
+        auto excess = texture_excess(r);
+        if (excess == 0)
             return;
-        }
-        check(result);
 
-        imv::image& image = view.images[view.image_index];
-        VkImage swapchain_image = view.swapchain_images[view.image_index];
+        r.scratch.reset();
+        pmr::vector<decltype(r.image_cache)::iterator> candidates(
+            r.scratch.get()
+        );
+        for (auto i = r.image_cache.begin(); i != r.image_cache.end(); i++) {
+            auto unused = r.frame_number - i->second.last_use;
+            if (unused >= r.texture_eviction_frames)
+                candidates.push_back(i);
+        }
+        ranges::sort(candidates, {}, [](auto i) { 
+            return i->second.last_use; 
+        });
+        VkDeviceSize evicted = 0;
+        for (auto i : candidates) {
+            if (evicted >= excess)
+                break;
+            evicted += i->second.size;
+            r.texture_memory -= i->second.size;
+            retire(r, i->second);
+            r.image_cache.erase(i);
+        }
+    }
 
-        if (!image.swapchain_image_view) {
+    // render passes of offscreen passes only differ in the attachment 
+    // descriptions, so they are compatible whatever their load and store 
+    // operations are
+    VkRenderPass offscreen_render_pass(
+        renderer_data& r, span<const VkAttachmentDescription> attachments
+    ) {
+        pmr::vector<VkAttachmentReference> references(r.scratch.get());
+        for (uint32_t i = 0; i < attachments.size(); i++) {
+            references.push_back({
+                .attachment = i,
+                .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            });
+        }
+        VkSubpassDescription subpass = {
+            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+            .colorAttachmentCount = uint32_t(references.size()),
+            .pColorAttachments = references.data(),
+        };
+        auto shader_stages = 
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | 
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        // waits for earlier passes drawing or sampling the attachments, and
+        // makes the draws visible to later ones
+        VkSubpassDependency dependencies[] = {
             {
-                VkSemaphoreCreateInfo create_info = {
-                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-                };
-                check(vkCreateSemaphore(
-                    r.device.get(), &create_info, nullptr,
-                    out_ptr(image.render_finished_semaphore)
-                ));
-            }
-
+                .srcSubpass = VK_SUBPASS_EXTERNAL,
+                .dstSubpass = 0,
+                .srcStageMask = 
+                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | 
+                    shader_stages,
+                .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                .dstAccessMask = 
+                    VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | 
+                    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            },
             {
-                VkFenceCreateInfo create_info = {
-                    .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-                    .flags = VK_FENCE_CREATE_SIGNALED_BIT,
-                };
-                check(vkCreateFence(
-                    r.device.get(), &create_info, nullptr, 
-                    out_ptr(image.render_finished_fence)
-                ));
-            }
+                .srcSubpass = 0,
+                .dstSubpass = VK_SUBPASS_EXTERNAL,
+                .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                .dstStageMask = 
+                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | 
+                    shader_stages,
+                .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                .dstAccessMask = 
+                    VK_ACCESS_SHADER_READ_BIT |
+                    VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | 
+                    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            },
+        };
+        VkRenderPassCreateInfo create_info = {
+            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+            .attachmentCount = uint32_t(attachments.size()),
+            .pAttachments = attachments.data(),
+            .subpassCount = 1,
+            .pSubpasses = &subpass,
+            .dependencyCount = uint32_t(std::size(dependencies)),
+            .pDependencies = dependencies,
+        };
+        auto insert = r.render_passes.try_emplace(create_info);
+        if (insert.second) {
+            check(vkCreateRenderPass(
+                r.device.get(), &create_info, nullptr, 
+                owned_out_ptr(*insert.first, r.device.get())
+            ));
+        }
+        return insert.first->get();
+    }
 
-            {
-                VkImageViewCreateInfo create_info = {
-                    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-                    .image = swapchain_image,
-                    .viewType = VK_IMAGE_VIEW_TYPE_2D,
-                    .format = r.surface_format.format,
-                    .subresourceRange = {
-                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                        .baseMipLevel = 0,
-                        .levelCount = 1,
-                        .baseArrayLayer = 0,
-                        .layerCount = 1,
-                    },
-                };
-                check(vkCreateImageView(
-                    r.device.get(), &create_info, nullptr,
-                    out_ptr(image.swapchain_image_view)
-                ));
+    bool lazily_allocated(const renderer_data& r) {
+        for (uint32_t i = 0; i < r.memory_properties.memoryTypeCount; i++) {
+            if (
+                r.memory_properties.memoryTypes[i].propertyFlags & 
+                VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT
+            ) {
+                return true;
             }
+        }
+        return false;
+    }
 
-            {
-                auto attachments = {
-                    image.swapchain_image_view.get(),
-                };
-                VkFramebufferCreateInfo create_info = {
-                    .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-                    .renderPass = r.render_pass.get(),
-                    .attachmentCount = uint32_t(attachments.size()),
-                    .pAttachments = attachments.begin(),
-                    .width = view.extent.width,
-                    .height = view.extent.height,
-                    .layers = 1,
-                };
-                check(vkCreateFramebuffer(
-                    r.device.get(), &create_info, nullptr,
-                    out_ptr(image.swapchain_framebuffer)
+    // images of targets that weren't read yet are transient, so tiled GPUs
+    // can keep them in tile memory
+    void create_render_target(
+        renderer_data& r, render_target& target, 
+        VkFormat format, VkExtent2D extent
+    ) {
+        // the previous image may still be drawn by frames, as may the 
+        // framebuffers using its view, whose handle can be reused
+        if (target.view) {
+            auto view = uint64_t(uintptr_t(target.view->get()));
+            r.framebuffers.erase_if([&](auto key, auto& framebuffer) {
+                // the views follow the render pass, extent and view count
+                if (!ranges::contains(key.subspan(4), view))
+                    return false;
+                retire(r, make_shared<unique_framebuffer>(
+                    std::move(framebuffer)
                 ));
-            }
+                return true;
+            });
+        }
+        retire(r, std::move(target.view));
+        retire(r, std::move(target.image));
+        retire(r, std::move(target.allocation));
+        target.format = format;
+        target.extent = extent;
+        target.transient = !target.read;
+        target.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        unique_image image;
+        unique_allocation allocation;
+        unique_image_view view;
+        {
+            VkImageCreateInfo create_info = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                .imageType = VK_IMAGE_TYPE_2D,
+                .format = format,
+                .extent = { extent.width, extent.height, 1 },
+                .mipLevels = 1,
+                .arrayLayers = 1,
+                .samples = VK_SAMPLE_COUNT_1_BIT,
+                .tiling = VK_IMAGE_TILING_OPTIMAL,
+                .usage = 
+                    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | 
+                    (target.transient ? 
+                        VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 
+                        VK_IMAGE_USAGE_SAMPLED_BIT),
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            };
+            VmaAllocationCreateInfo allocation_create_info {
+                .usage = target.transient && lazily_allocated(r) ? 
+                    VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED : 
+                    VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            };
+            check(vmaCreateImage(
+                r.allocator.get(), &create_info, &allocation_create_info,
+                owned_out_ptr(image, r.device.get()), 
+                owned_out_ptr(allocation, r.allocator.get()),
+                nullptr
+            ));
+        }
+        {
+            VkImageViewCreateInfo create_info = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                .image = image.get(),
+                .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                .format = format,
+                .subresourceRange = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .baseMipLevel = 0,
+                    .levelCount = 1,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
+            };
+            check(vkCreateImageView(
+                r.device.get(), &create_info, nullptr, 
+                owned_out_ptr(view, r.device.get())
+            ));
+        }
+        target.image = make_shared<unique_image>(std::move(image));
+        target.allocation = 
+            make_shared<unique_allocation>(std::move(allocation));
+        target.view = make_shared<unique_image_view>(std::move(view));
+    }
+
+    // the contents of the target are sampled by a draw
+    render_target& read_render_target(renderer_data& r, string_view name) {
+        auto entry = r.render_targets.find(name);
+        if (entry == r.render_targets.end())
+            throw std::runtime_error("render target wasn't drawn by a pass");
+        auto& target = entry->second;
+        if (target.drawn_frame != r.frame_number)
+            target.persistent = true;
+        if (!target.read) {
+            target.read = true;
+            create_render_target(r, target, target.format, target.extent);
+        }
+        return target;
+    }
 
+    // secondary command buffers are reused by later recordings of the frame
+    VkCommandBuffer next_secondary(renderer_data& r, imv::frame& frame) {
+        auto index = frame.pass_command_buffers_used++;
+        if (frame.pass_command_buffers.size() == index) {
             VkCommandBufferAllocateInfo command_buffer_info = {
                 .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
                 .commandPool = r.command_pool.get(),
-                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
                 .commandBufferCount = 1,
             };
             check(vkAllocateCommandBuffers(
                 r.device.get(), &command_buffer_info, 
-                &image.command_buffer
+                &frame.pass_command_buffers.emplace_back()
             ));
         }
+        auto command_buffer = frame.pass_command_buffers[index];
+        vkResetCommandBuffer(command_buffer, 0);
+        return command_buffer;
+    }
 
-        auto fence = image.render_finished_fence.get();
-
-        check(vkWaitForFences(
-            r.device.get(), 1, &fence,
-            VK_TRUE, ~0ul
-        ));
-        check(vkResetFences(
-            r.device.get(), 1, &fence
-        ));
-
-        vkResetCommandBuffer(image.command_buffer, 0);
-        image.pipelines.clear();
-        image.samplers.clear();
-        image.images.clear();
-        image.image_memories.clear();
-        image.image_views.clear();
-        image.descriptor_sets.clear();
-        image.uniform_buffer_size = 0;
-        image.vertex_buffer_size = 0;
-
+    // starts recording a secondary command buffer executed in the pass
+    VkCommandBuffer begin_pass_commands(
+        renderer_data& r, imv::frame& frame, const imv::pass& pass
+    ) {
+        auto command_buffer = next_secondary(r, frame);
+        VkCommandBufferInheritanceRenderingInfoKHR rendering_info = {
+            .sType = 
+                VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO_KHR,
+            .colorAttachmentCount = uint32_t(pass.color_formats.size()),
+            .pColorAttachmentFormats = pass.color_formats.data(),
+            .depthAttachmentFormat = 
+                pass.depth ? r.depth_format : VK_FORMAT_UNDEFINED,
+            .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+        };
+        VkCommandBufferInheritanceInfo inheritance_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+            .pNext = r.features.dynamic_rendering ? &rendering_info : nullptr,
+            .renderPass = pass.render_pass,
+            .subpass = 0,
+        };
         VkCommandBufferBeginInfo begin_info = {
             .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            .flags = 
+                VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+            .pInheritanceInfo = &inheritance_info,
+        };
+        check(vkBeginCommandBuffer(command_buffer, &begin_info));
+
+        // all pipelines use dynamic viewport and scissor, so they don't 
+        // need to be recreated when the window is resized
+        VkViewport viewport = {
+            .x = 0.0f, .y = 0.0f,
+            .width = float(pass.extent.width), 
+            .height = float(pass.extent.height),
+            .minDepth = 0.0f, .maxDepth = 1.0f,
+        };
+        vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+        VkRect2D scissor = {
+            .offset = {0, 0}, 
+            .extent = pass.extent,
+        };
+        vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+        return command_buffer;
+    }
+
+    // a pass without attachments and draws, reusing the arrays of a pass of
+    // an earlier frame
+    imv::pass recycled_pass(imv::frame& frame) {
+        if (frame.free_passes.empty())
+            return {};
+        auto pass = std::move(frame.free_passes.back());
+        frame.free_passes.pop_back();
+        pass.attachments.clear();
+        pass.sampled.clear();
+        pass.color_formats.clear();
+        pass.depth = false;
+        pass.deferred_draws.clear();
+        pass.sorted_command_buffer = VK_NULL_HANDLE;
+        return pass;
+    }
+
+    // starts recording the draws of a pass
+    void add_pass(renderer_data& r, imv::frame& frame, imv::pass pass) {
+        pass.command_buffer = begin_pass_commands(r, frame, pass);
+        frame.current_pass = frame.passes.size();
+        frame.passes.push_back(std::move(pass));
+    }
+
+    bool has_stencil(VkFormat format) {
+        return 
+            format == VK_FORMAT_D16_UNORM_S8_UINT ||
+            format == VK_FORMAT_D24_UNORM_S8_UINT ||
+            format == VK_FORMAT_D32_SFLOAT_S8_UINT ||
+            format == VK_FORMAT_S8_UINT;
+    }
+
+    // each swapchain image has its own depth image, so frames in flight 
+    // don't share one
+    void create_depth_image(
+        renderer_data& r, VkExtent2D extent, imv::image& image
+    ) {
+        VkImageCreateInfo create_info = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = r.depth_format,
+            .extent = { extent.width, extent.height, 1 },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = 
+                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | 
+                VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
         };
-        check(vkBeginCommandBuffer(
-            image.command_buffer, &begin_info
+        VmaAllocationCreateInfo allocation_create_info {
+            .usage = lazily_allocated(r) ? 
+                VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED : 
+                VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+        };
+        check(vmaCreateImage(
+            r.allocator.get(), &create_info, &allocation_create_info,
+            owned_out_ptr(image.depth_image, r.device.get()), 
+            owned_out_ptr(image.depth_allocation, r.allocator.get()),
+            nullptr
         ));
-        
-        auto clear_values = {
-            VkClearValue{
-                .color = {{0.0f, 0.0f, 0.0f, 1.0f}},
+
+        VkImageAspectFlags aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+        if (has_stencil(r.depth_format))
+            aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+        VkImageViewCreateInfo view_create_info = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = image.depth_image.get(),
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = r.depth_format,
+            .subresourceRange = {
+                .aspectMask = aspect,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
             },
         };
+        check(vkCreateImageView(
+            r.device.get(), &view_create_info, nullptr, 
+            owned_out_ptr(image.depth_view, r.device.get())
+        ));
+    }
 
-        VkRenderPassBeginInfo render_pass_begin_info = {
-            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-            .renderPass = r.render_pass.get(),
-            .framebuffer = image.swapchain_framebuffer.get(),
-            .renderArea = {
-                .offset = {0, 0}, .extent = view.extent,
-            },
-            .clearValueCount = static_cast<uint32_t>(clear_values.size()),
-            .pClearValues = clear_values.begin(),
+    void wait_frame(renderer_data& r) {
+        if (!r.frames) {
+            r.frames = make_unique<frame[]>(r.frames_in_flight);
+        }
+        imv::frame& frame = r.frames[r.frame_index];
+
+        if (!frame.swapchain_image_ready_semaphore) {
+            {
+                VkSemaphoreCreateInfo create_info = {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                };
+                check(vkCreateSemaphore(
+                    r.device.get(), &create_info, nullptr,
+                    owned_out_ptr(
+                        frame.swapchain_image_ready_semaphore, r.device.get()
+                    )
+                ));
+            }
+
+            VkCommandBufferAllocateInfo command_buffer_info = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = r.command_pool.get(),
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1,
+            };
+            check(vkAllocateCommandBuffers(
+                r.device.get(), &command_buffer_info, 
+                &frame.command_buffer
+            ));
+            // only a dedicated transfer queue needs uploads to be acquired
+            if (r.transfer_queue) {
+                check(vkAllocateCommandBuffers(
+                    r.device.get(), &command_buffer_info, 
+                    &frame.acquire_command_buffer
+                ));
+                VkSemaphoreCreateInfo create_info = {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                };
+                check(vkCreateSemaphore(
+                    r.device.get(), &create_info, nullptr,
+                    owned_out_ptr(
+                        frame.upload_finished_semaphore, r.device.get()
+                    )
+                ));
+                command_buffer_info.commandPool = 
+                    r.transfer_command_pool.get();
+            }
+            check(vkAllocateCommandBuffers(
+                r.device.get(), &command_buffer_info, 
+                &frame.upload_command_buffer
+            ));
+        }
+
+        // the image ready semaphore of this frame may only be reused once 
+        // the previous submission waiting on it has finished
+        auto timeline = r.timeline.get();
+        VkSemaphoreWaitInfoKHR wait_info = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+            .semaphoreCount = 1,
+            .pSemaphores = &timeline,
+            .pValues = &frame.timeline_value,
         };
+        check(r.functions.wait_semaphores(r.device.get(), &wait_info, ~0ull));
+        release_retired(r);
+
+        // the previous view is kept alive by the frames still rendering to it
+        frame.view.reset();
+
+        if (!r.view || r.view->outdated) {
+            auto view = create_view(r, r.view.get());
+            if (!view)
+                return;
+            r.view = std::move(view);
+        }
 
-        vkCmdBeginRenderPass(
-            image.command_buffer, &render_pass_begin_info,
-            VK_SUBPASS_CONTENTS_INLINE
+        VkResult result = vkAcquireNextImageKHR(
+            r.device.get(), r.view->swapchain.get(), ~0ul,
+            frame.swapchain_image_ready_semaphore.get(),
+            VK_NULL_HANDLE, &r.view->image_index
         );
-    }
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            // the semaphore wasn't signaled, so it can be used to retry right
+            // away instead of dropping the frame
+            r.view->outdated = true;
+            auto view = create_view(r, r.view.get());
+            if (!view)
+                return;
+            r.view = std::move(view);
+            result = vkAcquireNextImageKHR(
+                r.device.get(), r.view->swapchain.get(), ~0ul,
+                frame.swapchain_image_ready_semaphore.get(),
+                VK_NULL_HANDLE, &r.view->image_index
+            );
+        }
+        if (result == VK_SUBOPTIMAL_KHR) {
+            // the image was acquired, render this frame and recreate the 
+            // swapchain for the next one
+            r.view->outdated = true;
+        } else if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            r.view->outdated = true;
+            return;
+        } else {
+            check(result);
+        }
+
+        frame.view = r.view;
+        auto& view = *r.view;
 
-    bool draw(const draw_info& info) {
-        renderer_data& r = *get(info.renderer).d;
-        auto& view = r.view;
-        if (!view.images)
-            return false;
         imv::image& image = view.images[view.image_index];
+        VkImage swapchain_image = view.swapchain_images[view.image_index];
 
-        VkDeviceSize uniform_size = 128;
+        if (!image.swapchain_image_view) {
+            {
+                VkSemaphoreCreateInfo create_info = {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                };
+                check(vkCreateSemaphore(
+                    r.device.get(), &create_info, nullptr,
+                    owned_out_ptr(
+                        image.render_finished_semaphore, r.device.get()
+                    )
+                ));
+            }
 
-        VkDescriptorSetLayout descriptor_set_layout;
-        VkPipelineLayout pipeline_layout;
-        
-        vector<VkDescriptorSetLayoutBinding> descriptor_set_layout_binding {
             {
-                .binding = 0,
-                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                .descriptorCount = 1,
-                .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
-            },
+                VkImageViewCreateInfo create_info = {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                    .image = swapchain_image,
+                    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                    .format = r.surface_format.format,
+                    .subresourceRange = {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .baseMipLevel = 0,
+                        .levelCount = 1,
+                        .baseArrayLayer = 0,
+                        .layerCount = 1,
+                    },
+                };
+                check(vkCreateImageView(
+                    r.device.get(), &create_info, nullptr,
+                    owned_out_ptr(image.swapchain_image_view, r.device.get())
+                ));
+            }
+
+            if (r.depth_format != VK_FORMAT_UNDEFINED) {
+                create_depth_image(r, view.extent, image);
+            }
+
+            if (!r.features.dynamic_rendering) {
+                VkImageView attachments[] = {
+                    image.swapchain_image_view.get(), image.depth_view.get(),
+                };
+                VkFramebufferCreateInfo create_info = {
+                    .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+                    .renderPass = r.render_pass.get(),
+                    .attachmentCount = image.depth_view ? 2u : 1u,
+                    .pAttachments = attachments,
+                    .width = view.extent.width,
+                    .height = view.extent.height,
+                    .layers = 1,
+                };
+                check(vkCreateFramebuffer(
+                    r.device.get(), &create_info, nullptr,
+                    owned_out_ptr(image.swapchain_framebuffer, r.device.get())
+                ));
+            }
+        }
+
+        vkResetCommandBuffer(frame.command_buffer, 0);
+        // reused in the order they were added
+        while (!frame.passes.empty()) {
+            frame.free_passes.push_back(std::move(frame.passes.back()));
+            frame.passes.pop_back();
+        }
+        frame.pass_command_buffers_used = 0;
+        frame.compute_command_buffer = VK_NULL_HANDLE;
+        frame.descriptor_sets.clear();
+        frame.uniform_buffer_size = 0;
+        frame.vertex_buffer_size = 0;
+        frame.draw_data_size = 0;
+        frame.indirect_buffer_size = 0;
+        r.frame_number++;
+        vmaSetCurrentFrameIndex(r.allocator.get(), uint32_t(r.frame_number));
+        evict_textures(r);
+
+        auto pass = recycled_pass(frame);
+        pass.extent = view.extent;
+        pass.render_pass = r.render_pass.get();
+        pass.color_formats.push_back(r.surface_format.format);
+        pass.depth = r.depth_format != VK_FORMAT_UNDEFINED;
+        add_pass(r, frame, std::move(pass));
+
+        r.recording = true;
+    }
+
+    // leaves the module null if the code is invalid
+    void create_shader_module(
+        renderer_data& r, span<const uint32_t> code, shader_code& shader
+    ) {
+        VkShaderModuleCreateInfo create_info = {
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .codeSize = code.size_bytes(),
+            .pCode = code.data(),
+        };
+        unique_shader_module shader_module;
+        auto result = vkCreateShaderModule(
+            r.device.get(), &create_info, nullptr, 
+            owned_out_ptr(shader_module, r.device.get())
+        );
+        if (result == VK_SUCCESS) {
+            shader.reflection = reflect(code);
+            shader.shader_module = 
+                make_shared<unique_shader_module>(std::move(shader_module));
+        }
+    }
+
+    // drops code that no file loads anymore, along with the programs and 
+    // pipelines created from it. The module and pipelines live on until the
+    // frames using them finished, and the module while pipelines are still
+    // compiling with it
+    void release_shader_code(renderer_data& r, shader_code& code) {
+        for (auto& [file_name, file] : r.shader_cache) {
+            if (file.code == &code)
+                return;
+        }
+        // the open batch refers to its program
+        if (r.recording) {
+            auto& frame = r.frames[r.frame_index];
+            flush_batch(r, frame, frame.passes[frame.current_pass]);
+        }
+        auto hash = code.hash;
+        retire(r, std::move(code.shader_module));
+        r.programs.erase_if([&](auto key, program&) {
+            return uses_code(key, hash);
+        });
+        auto retire_pipeline = [&](auto key, auto& pipeline) {
+            if (!uses_code(key, hash))
+                return false;
+            retire(r, make_shared<decay_t<decltype(pipeline)>>(
+                std::move(pipeline)
+            ));
+            return true;
         };
+        r.pipelines.erase_if(retire_pipeline);
+        r.pipeline_libraries.erase_if(retire_pipeline);
+        r.linked_pipelines.erase_if(retire_pipeline);
+        r.shader_codes.erase(hash.low, hash.high);
+    }
+
+    shader_code& load_shader(renderer_data& r, const char* file_name) {
+        string_view file_name_view = file_name;
+        auto entry = r.shader_cache.find(file_name_view);
+        if (entry == r.shader_cache.end()) {
+            entry = r.shader_cache.emplace(
+                file_name_view, 
+                shader_module_file{ .file = { .path = file_name_view } }
+            ).first;
+        }
+        if (modified(entry->second.file, r.frame_number)) {
+            auto code = read_file(file_name);
+            hasher h;
+            visit_bytes(h, code.data(), code.size());
+            auto hash = h.finish();
+            // rewriting a file with the same code changes nothing
+            auto [shader, inserted] = 
+                r.shader_codes.try_emplace(hash.low, hash.high);
+            if (inserted) {
+                shader->hash = hash;
+                try {
+                    create_shader_module(r, span(
+                        reinterpret_cast<const uint32_t*>(code.data()), 
+                        code.size() / sizeof(uint32_t)
+                    ), *shader);
+                } catch (...) {
+                    r.shader_codes.erase(hash.low, hash.high);
+                    throw;
+                }
+                if (!shader->shader_module) {
+                    r.shader_codes.erase(hash.low, hash.high);
+                    shader = nullptr;
+                }
+            }
+            // invalid code keeps the previous version of the file
+            if (shader) {
+                auto previous = std::exchange(entry->second.code, shader);
+                if (previous && previous != shader)
+                    release_shader_code(r, *previous);
+            }
+        }
+        if (!entry->second.code)
+            throw std::runtime_error("invalid shader code");
+        return *entry->second.code;
+    }
+
+    // the value of a specialization constant in the stage, or its default
+    uint32_t specialized_value(
+        const VkPipelineShaderStageCreateInfo& stage, uint32_t constant_id,
+        uint32_t default_value
+    ) {
+        auto info = stage.pSpecializationInfo;
+        if (!info)
+            return default_value;
+        for (const auto& entry : span(info->pMapEntries, info->mapEntryCount)) {
+            if (entry.constantID != constant_id)
+                continue;
+            uint32_t value = 0;
+            memcpy(
+                &value, static_cast<const std::byte*>(info->pData) + 
+                    entry.offset, 
+                std::min(entry.size, sizeof(value))
+            );
+            return value;
+        }
+        return default_value;
+    }
+
+    program& get_program(
+        renderer_data& r, 
+        span<const VkPipelineShaderStageCreateInfo> stages,
+        span<const shader_reflection*> reflections,
+        span<const hash128> hashes
+    ) {
+        if (auto cached = r.programs.find(stages, code_hashes{hashes}))
+            return *cached;
+        // only cached once it passed the checks below
+        program p;
+        bool compute = 
+            stages.size() == 1 && 
+            stages[0].stage == VK_SHADER_STAGE_COMPUTE_BIT;
+        bool storage_blocks = false;
+
+        p.push_constant_range = {};
+        for (auto i = 0u; i < stages.size(); i++) {
+            auto stage = stages[i].stage;
+            for (auto binding : reflections[i]->bindings) {
+                if (binding.count_constant_id != ~0u) {
+                    binding.count = binding.count_factor * specialized_value(
+                        stages[i], binding.count_constant_id, 
+                        binding.count / binding.count_factor
+                    );
+                }
+                if (binding.set != 0) {
+                    throw std::runtime_error(
+                        "only descriptor set 0 is supported"
+                    );
+                }
+                auto existing = ranges::find(
+                    p.bindings, binding.binding, &shader_binding::binding
+                );
+                if (existing == p.bindings.end()) {
+                    binding.stages = stage;
+                    p.bindings.push_back(binding);
+                } else {
+                    existing->stages |= stage;
+                    existing->size = std::max(existing->size, binding.size);
+                }
+            }
+            if (reflections[i]->push_constant_size > 0) {
+                // a single range visible to all stages using it
+                p.push_constant_range.stageFlags |= stage;
+                p.push_constant_range.size = std::max(
+                    p.push_constant_range.size, 
+                    reflections[i]->push_constant_size
+                );
+            }
+        }
+        ranges::sort(p.bindings, {}, &shader_binding::binding);
 
-        for (auto& _: info.images) {
-            descriptor_set_layout_binding.push_back({
-                .binding = uint32_t(descriptor_set_layout_binding.size()),
-                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                .descriptorCount = 1,
-                .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+        if (p.push_constant_range.size > r.max_push_constants_size) {
+            throw std::runtime_error(
+                "push constant block exceeds maxPushConstantsSize"
+            );
+        }
+
+        vector<VkDescriptorSetLayoutBinding> layout_bindings;
+        for (auto& binding : p.bindings) {
+            if (binding.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+                if (binding.count != 1) {
+                    throw std::runtime_error(
+                        "arrays of uniform blocks are not supported"
+                    );
+                }
+                // there is only one uniform source per draw
+                if (p.push_constant_range.size > 0) {
+                    throw std::runtime_error(
+                        "uniform blocks and push constants can't be mixed"
+                    );
+                }
+                p.uniform_size = 
+                    std::max<VkDeviceSize>(p.uniform_size, binding.size);
+            } else if (binding.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) {
+                if (binding.count != 1) {
+                    throw std::runtime_error(
+                        "arrays of storage blocks are not supported"
+                    );
+                }
+                storage_blocks = true;
+            } else if (
+                binding.type != VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+            ) {
+                throw std::runtime_error("unsupported descriptor type");
+            }
+            layout_bindings.push_back({
+                .binding = binding.binding,
+                .descriptorType = binding.type,
+                .descriptorCount = binding.count,
+                .stageFlags = binding.stages,
             });
         }
-        
+        // the other storage blocks are bound to named storage buffers
+        p.draw_data = 
+            !compute && storage_blocks && 
+            p.uniform_size == 0 && p.push_constant_range.size == 0;
+
         {
             VkDescriptorSetLayoutCreateInfo descriptor_create_info = {
                 .sType = 
                     VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-                .bindingCount =
-                    uint32_t(descriptor_set_layout_binding.size()),
-                .pBindings = descriptor_set_layout_binding.data(),
+                .bindingCount = uint32_t(layout_bindings.size()),
+                .pBindings = layout_bindings.data(),
             };
             VkPipelineLayoutCreateInfo pipeline_create_info = {
                 .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
                 .setLayoutCount = 1,
+                .pushConstantRangeCount = 
+                    p.push_constant_range.size > 0 ? 1u : 0u,
+                .pPushConstantRanges = &p.push_constant_range,
             };
-            vector<uint64_t> key;
-            visit(key, descriptor_create_info);
-            visit(key, pipeline_create_info);
-
-            auto insert = r.pipeline_layouts.insert({key, {}});
-            if (insert.second) {
+            auto layout = r.pipeline_layouts.find(
+                descriptor_create_info, pipeline_create_info
+            );
+            if (!layout) {
+                pipeline created;
                 check(vkCreateDescriptorSetLayout(
                     r.device.get(), &descriptor_create_info, nullptr, 
-                    out_ptr(insert.first->second.descriptor_set_layout)
+                    owned_out_ptr(
+                        created.descriptor_set_layout, r.device.get()
+                    )
                 ));
-                descriptor_set_layout = 
-                    insert.first->second.descriptor_set_layout.get();
+                auto descriptor_set_layout = 
+                    created.descriptor_set_layout.get();
                 pipeline_create_info.pSetLayouts = &descriptor_set_layout;
                 check(vkCreatePipelineLayout(
                     r.device.get(), &pipeline_create_info, nullptr, 
-                    out_ptr(insert.first->second.pipeline_layout)
+                    owned_out_ptr(created.pipeline_layout, r.device.get())
                 ));
+                layout = r.pipeline_layouts.try_emplace(
+                    descriptor_create_info, pipeline_create_info
+                ).first;
+                *layout = std::move(created);
             }
-            descriptor_set_layout = 
-                insert.first->second.descriptor_set_layout.get();
-            pipeline_layout = insert.first->second.pipeline_layout.get();
+            p.descriptor_set_layout = layout->descriptor_set_layout.get();
+            p.pipeline_layout = layout->pipeline_layout.get();
         }
 
-        if (!image.uniform_buffer) {
-            VkBufferCreateInfo create_info {
-                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-                .size = image.uniform_buffer_capacity,
-                .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-            };
-            VmaAllocationCreateInfo allocation_create_info {
-                .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-                .usage = VMA_MEMORY_USAGE_AUTO,
+        if (!p.bindings.empty()) {
+            // TODO: may need a separate pool per pipeline layout
+            unsigned max_draw_count = 1024; // TODO: grow
+            unsigned max_sets = r.frames_in_flight * max_draw_count;
+            vector<VkDescriptorPoolSize> pool_size;
+            for (auto& binding : p.bindings) {
+                pool_size.push_back({
+                    .type = binding.type,
+                    .descriptorCount = binding.count * max_sets,
+                });
+            }
+            VkDescriptorPoolCreateInfo create_info = {
+                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT ,
+                .maxSets = max_sets,
+                .poolSizeCount = uint32_t(size(pool_size)),
+                .pPoolSizes = pool_size.data(),
             };
-            check(vmaCreateBuffer(
-                r.allocator.get(), &create_info, &allocation_create_info,
-                out_ptr(image.uniform_buffer), 
-                out_ptr(image.uniform_allocation),
-                nullptr
-            ));
-        }
 
-        size_t first_image_view = image.image_views.size();
+            auto pool = r.descriptor_pools.find(create_info);
+            if (!pool) {
+                unique_descriptor_pool created;
+                check(vkCreateDescriptorPool(
+                    r.device.get(), &create_info, nullptr, 
+                    owned_out_ptr(created, r.device.get()))
+                );
+                pool = r.descriptor_pools.try_emplace(create_info).first;
+                *pool = std::move(created);
+            }
+            p.descriptor_pool = pool->get();
+        }
 
-        for (const auto& image_file : info.images) {
-            auto file_name = image_file.file_name;
-            auto insert = r.image_cache.emplace(file_name, imv::image_file{});
-            auto last_write = filesystem::last_write_time(file_name);
-            auto entry = insert.first;
-            if (insert.second || last_write > entry->second.last_update) {
-                entry->second.last_update = last_write;
-                
-                unique_ktx_texture2 texture;
-                unique_image vulkan_image;
-                unique_device_memory memory;
-                unique_image_view view;
-                
-                ktxVulkanTexture vulkan_texture;
+        auto inserted = 
+            r.programs.try_emplace(stages, code_hashes{hashes}).first;
+        *inserted = std::move(p);
+        return *inserted;
+    }
 
-                auto result = ktxTexture2_CreateFromNamedFile(
-                    entry->first.c_str(), KTX_TEXTURE_CREATE_NO_FLAGS, 
-                    out_ptr(texture)
-                );
-                // TODO: check VkPhysicalDeviceProperties for supported formats
-                if (result == VK_SUCCESS) {
+    image_file& load_image(renderer_data& r, string_view file_name) {
+        auto entry = r.image_cache.find(file_name);
+        if (entry == r.image_cache.end()) {
+            entry = r.image_cache.emplace(
+                file_name, imv::image_file{ .file = { .path = file_name } }
+            ).first;
+        }
+        entry->second.last_use = r.frame_number;
+        if (modified(entry->second.file, r.frame_number)) {
+            unique_ktx_texture2 texture;
+            auto result = ktxTexture2_CreateFromNamedFile(
+                entry->first.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, 
+                out_ptr(texture)
+            );
+            // TODO: check VkPhysicalDeviceProperties for supported formats
+            if (result == KTX_SUCCESS) {
+                if (ktxTexture2_NeedsTranscoding(texture.get())) {
                     check(ktxTexture2_TranscodeBasis(
                         texture.get(), KTX_TTF_BC7_RGBA, 0
                     ));
-                    check(ktxTexture2_VkUploadEx(
-                        texture.get(), r.ktx_device.get(), &vulkan_texture, 
-                        VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, 
-                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-                    ));
-
-                    vulkan_image.reset(vulkan_texture.image);
-                    memory.reset(vulkan_texture.deviceMemory);
+                }
+                auto format = VkFormat(texture->vkFormat);
 
+                unique_image vulkan_image;
+                unique_allocation allocation;
+                unique_image_view view;
+                {
+                    VkImageCreateInfo create_info = {
+                        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                        .imageType = VK_IMAGE_TYPE_2D,
+                        .format = format,
+                        .extent = {
+                            texture->baseWidth, texture->baseHeight, 1
+                        },
+                        .mipLevels = texture->numLevels,
+                        .arrayLayers = 1,
+                        .samples = VK_SAMPLE_COUNT_1_BIT,
+                        .tiling = VK_IMAGE_TILING_OPTIMAL,
+                        .usage = 
+                            VK_IMAGE_USAGE_SAMPLED_BIT | 
+                            VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                    };
+                    VmaAllocationCreateInfo allocation_create_info {
+                        .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+                        .pool = r.texture_pool.get(),
+                    };
+                    auto result = vmaCreateImage(
+                        r.allocator.get(), &create_info, 
+                        &allocation_create_info,
+                        owned_out_ptr(vulkan_image, r.device.get()), 
+                        owned_out_ptr(allocation, r.allocator.get()),
+                        nullptr
+                    );
+                    // formats that can't use the pool's memory type get 
+                    // their own allocation
+                    if (result == VK_ERROR_FEATURE_NOT_PRESENT) {
+                        allocation_create_info.pool = VK_NULL_HANDLE;
+                        result = vmaCreateImage(
+                            r.allocator.get(), &create_info, 
+                            &allocation_create_info,
+                            owned_out_ptr(vulkan_image, r.device.get()), 
+                            owned_out_ptr(allocation, r.allocator.get()),
+                            nullptr
+                        );
+                    }
+                    check(result);
+                }
+                {
                     VkImageViewCreateInfo create_info = {
                         .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
                         .image = vulkan_image.get(),
                         .viewType = VK_IMAGE_VIEW_TYPE_2D,
-                        .format = vulkan_texture.imageFormat,
+                        .format = format,
                         .subresourceRange = {
                             .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
                             .baseMipLevel = 0,
-                            .levelCount = 1,
+                            .levelCount = texture->numLevels,
                             .baseArrayLayer = 0,
                             .layerCount = 1,
                         },
                     };
                     check(vkCreateImageView(
                         r.device.get(), &create_info, nullptr, 
-                        out_ptr(view)
+                        owned_out_ptr(view, r.device.get())
                     ));
-                    
-                    entry->second.image = 
-                        make_shared<unique_image>(std::move(vulkan_image));
-                    entry->second.device_memory = 
-                        make_shared<unique_device_memory>(std::move(memory));
-                    entry->second.view = 
-                        make_shared<unique_image_view>(std::move(view));
                 }
-            }
 
-            image.images.push_back(entry->second.image);
-            image.image_memories.push_back(entry->second.device_memory);
-            image.image_views.push_back(entry->second.view);
-        }
+                VkMemoryRequirements requirements;
+                vkGetImageMemoryRequirements(
+                    r.device.get(), vulkan_image.get(), &requirements
+                );
+                r.texture_memory -= entry->second.size;
+                r.texture_memory += requirements.size;
+                entry->second.size = requirements.size;
+                
+                // the previous version may still be used by frames
+                retire(r, entry->second);
+                entry->second.image = 
+                    make_shared<unique_image>(std::move(vulkan_image));
+                entry->second.allocation = 
+                    make_shared<unique_allocation>(std::move(allocation));
+                entry->second.view = 
+                    make_shared<unique_image_view>(std::move(view));
 
-        image.samplers.push_back({});
+                // the data is copied when the frame is submitted
+                r.pending_uploads.push_back({
+                    std::move(texture), 
+                    entry->second.image, entry->second.allocation,
+                });
+            }
+        }
+        return entry->second;
+    }
 
-        {
-            VkSamplerCreateInfo create_info = {
+    VkSampler get_sampler(
+        renderer_data& r, const VkSamplerCreateInfo& sampler_info
+    ) {
+        VkSamplerCreateInfo create_info = sampler_info;
+        if (create_info.sType != VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO) {
+            // not filled in by the caller
+            create_info = {
                 .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
                 .magFilter = VK_FILTER_LINEAR,
                 .minFilter = VK_FILTER_LINEAR,
@@ -804,86 +2633,1039 @@ namespace imv {
                 .minLod = 0.0,
                 .maxLod = VK_LOD_CLAMP_NONE,
             };
+        }
+        auto insert = r.samplers.try_emplace(create_info);
+        if (insert.second) {
             check(vkCreateSampler(
                 r.device.get(), &create_info, nullptr, 
-                out_ptr(image.samplers.back())
+                owned_out_ptr(*insert.first, r.device.get())
             ));
         }
+        return insert.first->get();
+    }
 
-        image.pipelines.push_back({});
-        
-        r.pipeline_shader_stages.resize(info.stages.size());
+    // rethrows why compiling failed after dropping the pipeline from the 
+    // cache, so the next draw compiles it again
+    template<class... Key>
+    VkPipeline compiled_pipeline(
+        flat_hash_map<shared_future<unique_pipeline>>& cache,
+        const shared_future<unique_pipeline>& compiled, const Key&... key
+    ) {
+        try {
+            return compiled.get().get();
+        } catch (...) {
+            cache.erase(key...);
+            throw;
+        }
+    }
 
-        for (auto i = 0u; i < info.stages.size(); i++) {
-            const char* fileName = (info.stages.begin() + i)->code_file_name;
-            string_view fileNameView = fileName;
-            auto insert = r.shader_cache.insert({string(fileNameView), {}});
-            auto last_write = filesystem::last_write_time(fileNameView);
-            auto entry = insert.first;
-            if (insert.second || last_write > entry->second.last_update) {
-                entry->second.last_update = last_write;
-                auto code = read_file(fileName);
-                VkShaderModuleCreateInfo create_info = {
-                    .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-                    .codeSize = (size_t)(code.size()),
-                    .pCode = reinterpret_cast<uint32_t*>(code.data()),
-                };
-                unique_shader_module shader_module;
-                auto result = vkCreateShaderModule(
-                    r.device.get(), &create_info, nullptr, 
-                    out_ptr(shader_module)
-                );
-                if (result == VK_SUCCESS) {
-                    entry->second.shader_module = std::move(shader_module);
+    // a part of pipelines, compiled on the compile threads unless blocking.
+    // Null while it is compiling
+    VkPipeline pipeline_library(
+        renderer_data& r, VkGraphicsPipelineLibraryFlagsEXT part,
+        const VkGraphicsPipelineCreateInfo& create_info, 
+        span<const hash128> hashes,
+        span<const shared_ptr<unique_shader_module>> shader_modules,
+        bool block
+    ) {
+        auto [compiled, inserted] = r.pipeline_libraries.try_emplace(
+            part, create_info, code_hashes{hashes}
+        );
+        if (inserted) {
+            packaged_task<unique_pipeline()> compile(
+                [
+                    device = r.device.get(), 
+                    cache = r.pipeline_cache.get(), 
+                    part,
+                    state = make_unique<pipeline_state>(
+                        create_info, shader_modules
+                    )
+                ] {
+                    VkGraphicsPipelineLibraryCreateInfoEXT 
+                    library_create_info = {
+                        .sType = 
+                            VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT,
+                        .pNext = state->create_info.pNext,
+                        .flags = part,
+                    };
+                    auto library_info = state->create_info;
+                    library_info.pNext = &library_create_info;
+                    library_info.flags |= VK_PIPELINE_CREATE_LIBRARY_BIT_KHR;
+                    unique_pipeline library;
+                    check(vkCreateGraphicsPipelines(
+                        device, cache, 1, &library_info, nullptr, 
+                        owned_out_ptr(library, device)
+                    ));
+                    return library;
                 }
+            );
+            *compiled = compile.get_future().share();
+            if (block)
+                compile();
+            else
+                r.compile_threads->submit(std::move(compile));
+        }
+        if (block || compiled->wait_for(0s) == future_status::ready) {
+            return compiled_pipeline(
+                r.pipeline_libraries, *compiled, 
+                part, create_info, code_hashes{hashes}
+            );
+        }
+        return VK_NULL_HANDLE;
+    }
+
+    // links a pipeline from libraries that only see the state they depend
+    // on, so they are shared with other pipelines agreeing on that state.
+    // Null while a library is compiling
+    VkPipeline link_pipeline(
+        renderer_data& r, const VkGraphicsPipelineCreateInfo& info,
+        span<const hash128> hashes,
+        span<const shared_ptr<unique_shader_module>> shader_modules,
+        bool block
+    ) {
+        if (auto linked = r.linked_pipelines.find(info, code_hashes{hashes}))
+            return linked->get();
+
+        pmr::vector<VkPipelineShaderStageCreateInfo> 
+            pre_rasterization_stages(r.scratch.get());
+        pmr::vector<VkPipelineShaderStageCreateInfo> 
+            fragment_stages(r.scratch.get());
+        pmr::vector<hash128> pre_rasterization_hashes(r.scratch.get());
+        pmr::vector<hash128> fragment_hashes(r.scratch.get());
+        for (auto i = 0u; i < info.stageCount; i++) {
+            if (info.pStages[i].stage == VK_SHADER_STAGE_FRAGMENT_BIT) {
+                fragment_stages.push_back(info.pStages[i]);
+                fragment_hashes.push_back(hashes[i]);
+            } else {
+                pre_rasterization_stages.push_back(info.pStages[i]);
+                pre_rasterization_hashes.push_back(hashes[i]);
             }
-            VkPipelineShaderStageCreateInfo create_info = 
-                (info.stages.begin() + i)->info;
-            create_info.sType = 
-                VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-            create_info.module = entry->second.shader_module.get();
-            if (create_info.pName == nullptr)
-                create_info.pName = "main";
-            r.pipeline_shader_stages[i] = create_info;
         }
 
-        if (!image.vertex_buffer) {
-            VkBufferCreateInfo create_info {
-                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-                .size = image.vertex_buffer_capacity,
-                .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VkPipeline libraries[] = {
+            pipeline_library(
+                r, VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT, 
+                {
+                    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                    .pVertexInputState = info.pVertexInputState,
+                    .pInputAssemblyState = info.pInputAssemblyState,
+                    .pDynamicState = info.pDynamicState,
+                },
+                {}, shader_modules, block
+            ),
+            pipeline_library(
+                r, 
+                VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT, 
+                {
+                    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                    .stageCount = uint32_t(pre_rasterization_stages.size()),
+                    .pStages = pre_rasterization_stages.data(),
+                    .pTessellationState = info.pTessellationState,
+                    .pViewportState = info.pViewportState,
+                    .pRasterizationState = info.pRasterizationState,
+                    .pDynamicState = info.pDynamicState,
+                    .layout = info.layout,
+                    .renderPass = info.renderPass,
+                    .subpass = info.subpass,
+                },
+                pre_rasterization_hashes, shader_modules, block
+            ),
+            pipeline_library(
+                r, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT, 
+                {
+                    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                    // without formats, depth state would be ignored
+                    .pNext = info.pNext,
+                    .stageCount = uint32_t(fragment_stages.size()),
+                    .pStages = fragment_stages.data(),
+                    .pMultisampleState = info.pMultisampleState,
+                    .pDepthStencilState = info.pDepthStencilState,
+                    .pDynamicState = info.pDynamicState,
+                    .layout = info.layout,
+                    .renderPass = info.renderPass,
+                    .subpass = info.subpass,
+                },
+                fragment_hashes, shader_modules, block
+            ),
+            pipeline_library(
+                r, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT,
+                {
+                    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                    .pNext = info.pNext,
+                    .pMultisampleState = info.pMultisampleState,
+                    .pColorBlendState = info.pColorBlendState,
+                    .pDynamicState = info.pDynamicState,
+                    .renderPass = info.renderPass,
+                    .subpass = info.subpass,
+                },
+                {}, shader_modules, block
+            ),
+        };
+
+        if (ranges::any_of(libraries, [](VkPipeline p) { return !p; }))
+            return VK_NULL_HANDLE;
+
+        // without link time optimization, this is fast
+        VkPipelineLibraryCreateInfoKHR library_info = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR,
+            .libraryCount = uint32_t(std::size(libraries)),
+            .pLibraries = libraries,
+        };
+        VkGraphicsPipelineCreateInfo create_info = {
+            .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+            .pNext = &library_info,
+            .layout = info.layout,
+        };
+        unique_pipeline linked;
+        check(vkCreateGraphicsPipelines(
+            r.device.get(), r.pipeline_cache.get(), 1, &create_info, nullptr, 
+            owned_out_ptr(linked, r.device.get())
+        ));
+        auto inserted = 
+            r.linked_pipelines.try_emplace(info, code_hashes{hashes}).first;
+        *inserted = std::move(linked);
+        return inserted->get();
+    }
+
+    void record_draw(
+        renderer_data& r, VkCommandBuffer command_buffer, 
+        const draw_commands& draw
+    ) {
+        vkCmdBindPipeline(
+            command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, draw.pipeline
+        );
+
+        if (r.features.extended_dynamic_state) {
+            r.functions.cmd_set_primitive_topology(
+                command_buffer, draw.topology
+            );
+        }
+
+        if (r.features.vertex_input_dynamic_state) {
+            r.functions.cmd_set_vertex_input(
+                command_buffer, 
+                uint32_t(draw.vertex_bindings.size()), 
+                draw.vertex_bindings.data(),
+                uint32_t(draw.vertex_attributes.size()), 
+                draw.vertex_attributes.data()
+            );
+        }
+
+        if (!draw.vertex_buffers.empty()) {
+            vkCmdBindVertexBuffers(
+                command_buffer, 0, uint32_t(draw.vertex_buffers.size()), 
+                draw.vertex_buffers.data(), draw.vertex_offsets.data()
+            );
+        }
+
+        if (draw.descriptor_set) {
+            vkCmdBindDescriptorSets(
+                command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                draw.pipeline_layout, 0, 1, 
+                &draw.descriptor_set, 0, nullptr
+            );
+        }
+
+        if (!draw.push_constants.empty()) {
+            vkCmdPushConstants(
+                command_buffer, draw.pipeline_layout, 
+                draw.push_constant_stages, 0, 
+                uint32_t(draw.push_constants.size()), 
+                draw.push_constants.data()
+            );
+        }
+
+        if (!draw.indirect_buffer) {
+            vkCmdDraw(command_buffer, draw.vertex_count, 1, 0, 0);
+        } else if (r.features.draw_indirect_count) {
+            r.functions.cmd_draw_indirect_count(
+                command_buffer, draw.indirect_buffer, draw.indirect_offset,
+                draw.indirect_buffer, draw.count_offset, draw.draw_count,
+                sizeof(VkDrawIndirectCommand)
+            );
+        } else {
+            vkCmdDrawIndirect(
+                command_buffer, draw.indirect_buffer, draw.indirect_offset,
+                draw.draw_count, sizeof(VkDrawIndirectCommand)
+            );
+        }
+    }
+
+    // host visible buffers of a frame are created on first use
+    void create_host_buffer(
+        renderer_data& r, size_t capacity, VkBufferUsageFlags usage,
+        unique_buffer& buffer, unique_allocation& allocation
+    ) {
+        if (buffer)
+            return;
+        VkBufferCreateInfo create_info {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = capacity,
+            .usage = usage,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        };
+        VmaAllocationCreateInfo allocation_create_info {
+            .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+            .usage = VMA_MEMORY_USAGE_AUTO,
+        };
+        check(vmaCreateBuffer(
+            r.allocator.get(), &create_info, &allocation_create_info,
+            owned_out_ptr(buffer, r.device.get()), 
+            owned_out_ptr(allocation, r.allocator.get()),
+            nullptr
+        ));
+    }
+
+    VkDescriptorBufferInfo write_draw_data(
+        renderer_data& r, imv::frame& frame, const void* data, size_t size
+    ) {
+        create_host_buffer(
+            r, frame.draw_data_capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            frame.draw_data_buffer, frame.draw_data_allocation
+        );
+        auto offset = 
+            aligned(frame.draw_data_size, r.storage_offset_alignment);
+        if (offset + size > frame.draw_data_capacity)
+            throw std::runtime_error("draw data exceeds its buffer");
+        check(vmaCopyMemoryToAllocation(
+            r.allocator.get(), data, frame.draw_data_allocation.get(), 
+            offset, size
+        ));
+        frame.draw_data_size = offset + size;
+        return {
+            .buffer = frame.draw_data_buffer.get(),
+            .offset = offset,
+            .range = size,
+        };
+    }
+
+    // uniforms are bound to the uniform blocks of the program, storage 
+    // buffers and images are assigned to the other bindings in order
+    VkDescriptorSet allocate_descriptor_set(
+        renderer_data& r, imv::frame& frame, const program& program,
+        const VkDescriptorBufferInfo& uniforms, 
+        span<const VkDescriptorBufferInfo> storage_buffers,
+        span<const VkDescriptorImageInfo> images
+    ) {
+        if (!program.descriptor_pool)
+            return VK_NULL_HANDLE;
+        frame.descriptor_sets.push_back(
+            {{}, {r.device.get(), program.descriptor_pool}}
+        );
+        VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = program.descriptor_pool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &program.descriptor_set_layout,
+        };
+        check(vkAllocateDescriptorSets(
+            r.device.get(), &descriptor_set_allocate_info, 
+            out_ptr(frame.descriptor_sets.back())
+        ));
+        auto descriptor_set = frame.descriptor_sets.back().get();
+
+        pmr::vector<VkWriteDescriptorSet> write_descriptor_set(
+            r.scratch.get()
+        );
+        size_t storage_index = 0, image_index = 0;
+        for (auto& binding : program.bindings) {
+            VkWriteDescriptorSet write = {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = descriptor_set,
+                .dstBinding = binding.binding,
+                .dstArrayElement = 0,
+                .descriptorCount = binding.count,
+                .descriptorType = binding.type,
+            };
+            if (binding.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+                write.pBufferInfo = &uniforms;
+            } else if (binding.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) {
+                if (storage_index == storage_buffers.size()) {
+                    throw std::runtime_error(
+                        "storage buffers don't match the shader"
+                    );
+                }
+                write.pBufferInfo = &storage_buffers[storage_index++];
+            } else {
+                if (image_index + binding.count > images.size()) {
+                    throw std::runtime_error(
+                        "draw_info::images doesn't match the shader"
+                    );
+                }
+                write.pImageInfo = &images[image_index];
+                image_index += binding.count;
+            }
+            write_descriptor_set.push_back(write);
+        }
+        vkUpdateDescriptorSets(
+            r.device.get(), 
+            size(write_descriptor_set), data(write_descriptor_set), 0, nullptr
+        );
+        return descriptor_set;
+    }
+
+    // uniform blocks get their own range of the frame's uniform buffer
+    VkDescriptorBufferInfo write_uniforms(
+        renderer_data& r, imv::frame& frame, const program& program, 
+        const void* data, VkDeviceSize size
+    ) {
+        if (program.uniform_size == 0)
+            return {};
+        create_host_buffer(
+            r, frame.uniform_buffer_capacity, 
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            frame.uniform_buffer, frame.uniform_allocation
+        );
+        VkDescriptorBufferInfo info = {
+            .buffer = frame.uniform_buffer.get(),
+            .offset = frame.uniform_buffer_size,
+            .range = program.uniform_size,
+        };
+        check(vmaCopyMemoryToAllocation(
+            r.allocator.get(), data, frame.uniform_allocation.get(), 
+            frame.uniform_buffer_size, 
+            std::min<VkDeviceSize>(size, program.uniform_size)
+        ));
+        frame.uniform_buffer_size += 
+            aligned(program.uniform_size, r.offset_alignment);
+        return info;
+    }
+
+    // the uniform source of programs with a push constant block, whole 
+    // words of it since push constant sizes are multiples of 4
+    span<const std::byte> push_constant_data(
+        const program& program, const void* data, VkDeviceSize size
+    ) {
+        if (program.push_constant_range.size == 0)
+            return {};
+        return {
+            static_cast<const std::byte*>(data),
+            size_t(std::min<VkDeviceSize>(
+                size, program.push_constant_range.size
+            ) & ~VkDeviceSize(3)),
+        };
+    }
+
+    // dispatches are recorded outside of passes and executed before them
+    VkCommandBuffer compute_commands(renderer_data& r, imv::frame& frame) {
+        if (frame.compute_command_buffer)
+            return frame.compute_command_buffer;
+        auto command_buffer = next_secondary(r, frame);
+        VkCommandBufferInheritanceInfo inheritance_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        };
+        VkCommandBufferBeginInfo begin_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            .pInheritanceInfo = &inheritance_info,
+        };
+        check(vkBeginCommandBuffer(command_buffer, &begin_info));
+        frame.compute_command_buffer = command_buffer;
+        return command_buffer;
+    }
+
+    // compute pipelines share the cache of graphics pipelines, fallback is
+    // treated like skip
+    VkPipeline get_compute_pipeline(
+        renderer_data& r, const VkComputePipelineCreateInfo& create_info,
+        const shader_code& shader, compile_policy policy
+    ) {
+        code_hashes hashes{span(&shader.hash, 1)};
+        auto [compiled, inserted] = 
+            r.pipelines.try_emplace(create_info, hashes);
+        if (inserted) {
+            packaged_task<unique_pipeline()> compile(
+                [
+                    device = r.device.get(), 
+                    cache = r.pipeline_cache.get(), 
+                    state = make_unique<compute_pipeline_state>(
+                        create_info, shader.shader_module
+                    )
+                ] {
+                    unique_pipeline pipeline;
+                    check(vkCreateComputePipelines(
+                        device, cache, 1, &state->create_info, nullptr, 
+                        owned_out_ptr(pipeline, device)
+                    ));
+                    return pipeline;
+                }
+            );
+            *compiled = compile.get_future().share();
+            if (policy == compile_policy::block)
+                compile();
+            else
+                r.compile_threads->submit(std::move(compile));
+        }
+        if (
+            policy == compile_policy::block || 
+            compiled->wait_for(0s) == future_status::ready
+        ) {
+            return compiled_pipeline(
+                r.pipelines, *compiled, create_info, hashes
+            );
+        }
+        return VK_NULL_HANDLE;
+    }
+
+    VkDescriptorBufferInfo get_storage_buffer(
+        renderer_data& r, imv::frame& frame, const storage_buffer_info& info
+    ) {
+        auto entry = r.storage_buffers.find(info.name);
+        if (entry == r.storage_buffers.end()) {
+            entry = r.storage_buffers.emplace(
+                string(info.name), storage_buffer{}
+            ).first;
+        }
+        auto& target = entry->second;
+        if (target.size != info.size) {
+            // the previous buffer may still be used by frames
+            retire(r, std::move(target.buffer));
+            retire(r, std::move(target.allocation));
+            VkBufferCreateInfo create_info {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = info.size,
+                .usage = 
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | 
+                    VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                 .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
             };
             VmaAllocationCreateInfo allocation_create_info {
-                .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-                .usage = VMA_MEMORY_USAGE_AUTO,
+                .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
             };
+            unique_buffer buffer;
+            unique_allocation allocation;
             check(vmaCreateBuffer(
                 r.allocator.get(), &create_info, &allocation_create_info,
-                out_ptr(image.vertex_buffer), 
-                out_ptr(image.vertex_allocation),
+                owned_out_ptr(buffer, r.device.get()), 
+                owned_out_ptr(allocation, r.allocator.get()),
                 nullptr
             ));
+            target.buffer = make_shared<unique_buffer>(std::move(buffer));
+            target.allocation = 
+                make_shared<unique_allocation>(std::move(allocation));
+            target.size = info.size;
+            // dispatches wait for transfers as well
+            vkCmdFillBuffer(
+                compute_commands(r, frame), target.buffer->get(), 0, 
+                VK_WHOLE_SIZE, 0
+            );
+        }
+        return {
+            .buffer = target.buffer->get(),
+            .offset = 0,
+            .range = target.size,
+        };
+    }
+
+    // each dispatch waits for the writes of the previous ones, and for the
+    // draws of earlier frames reading the storage buffers it may overwrite
+    void record_dispatch(
+        renderer_data& r, imv::frame& frame, VkPipeline pipeline, 
+        const program& program, VkDescriptorSet descriptor_set, 
+        span<const std::byte> push_constants, 
+        uint32_t group_count_x, uint32_t group_count_y, 
+        uint32_t group_count_z
+    ) {
+        auto command_buffer = compute_commands(r, frame);
+        VkMemoryBarrier barrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = 
+                VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT |
+                VK_ACCESS_INDIRECT_COMMAND_READ_BIT | 
+                VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+                VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+            .dstAccessMask = 
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        };
+        vkCmdPipelineBarrier(
+            command_buffer, 
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | 
+                VK_PIPELINE_STAGE_TRANSFER_BIT |
+                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | 
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+                VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | 
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+            0, 1, &barrier, 0, nullptr, 0, nullptr
+        );
+        vkCmdBindPipeline(
+            command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline
+        );
+        if (descriptor_set) {
+            vkCmdBindDescriptorSets(
+                command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, 
+                program.pipeline_layout, 0, 1, &descriptor_set, 0, nullptr
+            );
+        }
+        if (!push_constants.empty()) {
+            vkCmdPushConstants(
+                command_buffer, program.pipeline_layout, 
+                program.push_constant_range.stageFlags, 0, 
+                uint32_t(push_constants.size()), push_constants.data()
+            );
         }
+        vkCmdDispatch(
+            command_buffer, group_count_x, group_count_y, group_count_z
+        );
+    }
+
+    // dispatches run before the passes, which wait for their writes
+    void record_dispatches(imv::frame& frame) {
+        check(vkEndCommandBuffer(frame.compute_command_buffer));
+        vkCmdExecuteCommands(
+            frame.command_buffer, 1, &frame.compute_command_buffer
+        );
+        // storage buffers first used by draws are only cleared
+        VkMemoryBarrier barrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = 
+                VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = 
+                VK_ACCESS_INDIRECT_COMMAND_READ_BIT | 
+                VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+                VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+        };
+        vkCmdPipelineBarrier(
+            frame.command_buffer, 
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | 
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | 
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+                VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | 
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr
+        );
+    }
 
-        vector<VkVertexInputBindingDescription> 
-            vertex_input_binding_descriptions;
-        vector<VkVertexInputAttributeDescription> 
-            vertex_input_attribute_description;
+    // compiled by the build into a list of SPIR-V words
+    const uint32_t frustum_cull_code[] = 
+    #include "shaders/frustum_cull.glsl.inc"
+    ;
 
-        vector<VkBuffer> vertex_buffers;
-        vector<VkDeviceSize> vertex_offsets;
-        for (const auto& binding : info.vertex_input_bindings) {
-            vertex_input_binding_descriptions.push_back(binding.description);
+    // the built in culling shader zeroes the instance count of the draws
+    // outside the frustum, so gl_DrawID still indexes the draw data
+    void cull_batch(
+        renderer_data& r, imv::frame& frame, const draw_batch& batch,
+        const VkDescriptorBufferInfo& commands
+    ) {
+        auto& shader = r.frustum_cull;
+        if (!shader.shader_module) {
+            create_shader_module(r, frustum_cull_code, shader);
+            if (!shader.shader_module)
+                throw std::runtime_error("invalid frustum culling shader");
+            hasher h;
+            visit_bytes(h, frustum_cull_code, sizeof(frustum_cull_code));
+            shader.hash = h.finish();
+        }
+        VkPipelineShaderStageCreateInfo stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = shader.shader_module->get(),
+            .pName = "main",
+        };
+        const shader_reflection* reflection = &shader.reflection;
+        auto& program = get_program(
+            r, span(&stage, 1), span(&reflection, 1), span(&shader.hash, 1)
+        );
+        VkComputePipelineCreateInfo create_info = {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = stage,
+            .layout = program.pipeline_layout,
+        };
+        auto pipeline = get_compute_pipeline(
+            r, create_info, shader, compile_policy::block
+        );
+
+        VkDescriptorBufferInfo storage_buffers[] = {
+            write_draw_data(
+                r, frame, batch.bounding_spheres.data(), 
+                batch.bounding_spheres.size() * sizeof(std::array<float, 4>)
+            ),
+            commands,
+        };
+        auto descriptor_set = allocate_descriptor_set(
+            r, frame, program, {}, storage_buffers, {}
+        );
+        struct {
+            std::array<std::array<float, 4>, 6> frustum_planes;
+            uint32_t draw_count;
+        } constants = {
+            batch.frustum_planes, uint32_t(batch.commands.size()),
+        };
+        record_dispatch(
+            r, frame, pipeline, program, descriptor_set, 
+            as_bytes(span(&constants, 1)), 
+            (constants.draw_count + 63) / 64, 1, 1
+        );
+    }
+
+    // with dynamic vertex input, the descriptions are set when drawing
+    void dynamic_vertex_input(
+        span<const VkVertexInputBindingDescription> bindings,
+        span<const VkVertexInputAttributeDescription> attributes,
+        pmr::vector<VkVertexInputBindingDescription2EXT>& dynamic_bindings,
+        pmr::vector<VkVertexInputAttributeDescription2EXT>& 
+            dynamic_attributes
+    ) {
+        for (const auto& binding : bindings) {
+            dynamic_bindings.push_back({
+                .sType = 
+                    VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT,
+                .binding = binding.binding,
+                .stride = binding.stride,
+                .inputRate = binding.inputRate,
+                .divisor = 1,
+            });
+        }
+        for (const auto& attribute : attributes) {
+            dynamic_attributes.push_back({
+                .sType = 
+                    VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT,
+                .location = attribute.location,
+                .binding = attribute.binding,
+                .format = attribute.format,
+                .offset = attribute.offset,
+            });
+        }
+    }
+
+    // uploads the vertices, storage block array and commands of the batch 
+    // and draws it with a single indirect draw
+    void flush_batch(renderer_data& r, imv::frame& frame, imv::pass& pass) {
+        auto& batch = pass.batch;
+        if (batch.commands.empty())
+            return;
+
+        pmr::vector<VkBuffer> vertex_buffers(r.scratch.get());
+        pmr::vector<VkDeviceSize> vertex_offsets(r.scratch.get());
+        for (const auto& data : batch.vertex_data) {
             check(vmaCopyMemoryToAllocation(
-                r.allocator.get(), binding.buffer_source_pointer, 
-                image.vertex_allocation.get(), 
-                image.vertex_buffer_size, binding.buffer_source_size
+                r.allocator.get(), data.data(), 
+                frame.vertex_allocation.get(), 
+                frame.vertex_buffer_size, data.size()
+            ));
+            vertex_buffers.push_back(frame.vertex_buffer.get());
+            vertex_offsets.push_back(frame.vertex_buffer_size);
+            frame.vertex_buffer_size += data.size();
+        }
+
+        create_host_buffer(
+            r, frame.indirect_buffer_capacity, 
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | 
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            frame.indirect_buffer, frame.indirect_allocation
+        );
+        auto draw_count = uint32_t(batch.commands.size());
+        auto commands_size = draw_count * sizeof(VkDrawIndirectCommand);
+        // bound as a storage buffer when culling
+        auto indirect_offset = aligned(
+            frame.indirect_buffer_size, 
+            std::max<size_t>(r.storage_offset_alignment, 4)
+        );
+        auto count_offset = indirect_offset + commands_size;
+        if (count_offset + sizeof(draw_count) > frame.indirect_buffer_capacity)
+            throw std::runtime_error("batches exceed the indirect buffer");
+        check(vmaCopyMemoryToAllocation(
+            r.allocator.get(), batch.commands.data(), 
+            frame.indirect_allocation.get(), indirect_offset, commands_size
+        ));
+        check(vmaCopyMemoryToAllocation(
+            r.allocator.get(), &draw_count, 
+            frame.indirect_allocation.get(), count_offset, sizeof(draw_count)
+        ));
+        frame.indirect_buffer_size = count_offset + sizeof(draw_count);
+        if (batch.culled) {
+            cull_batch(r, frame, batch, {
+                .buffer = frame.indirect_buffer.get(),
+                .offset = indirect_offset,
+                .range = commands_size,
+            });
+        }
+
+        pmr::vector<VkDescriptorBufferInfo> storage_buffers(r.scratch.get());
+        if (batch.program->draw_data) {
+            storage_buffers.push_back(write_draw_data(
+                r, frame, batch.draw_data.data(), batch.draw_data.size()
             ));
-            vertex_buffers.push_back(image.vertex_buffer.get());
-            vertex_offsets.push_back(image.vertex_buffer_size);
-            image.vertex_buffer_size += binding.buffer_source_size;
-            
+        }
+        storage_buffers.insert(
+            storage_buffers.end(), 
+            batch.storage_buffers.begin(), batch.storage_buffers.end()
+        );
+        auto descriptor_set = allocate_descriptor_set(
+            r, frame, *batch.program, {}, storage_buffers, batch.images
+        );
+
+        pmr::vector<VkVertexInputBindingDescription2EXT> bindings(
+            r.scratch.get()
+        );
+        pmr::vector<VkVertexInputAttributeDescription2EXT> attributes(
+            r.scratch.get()
+        );
+        if (r.features.vertex_input_dynamic_state) {
+            dynamic_vertex_input(
+                batch.vertex_bindings, batch.vertex_attributes,
+                bindings, attributes
+            );
+        }
+
+        record_draw(r, pass.command_buffer, {
+            .pipeline = batch.pipeline,
+            .pipeline_layout = batch.program->pipeline_layout,
+            .topology = batch.topology,
+            .vertex_bindings = bindings,
+            .vertex_attributes = attributes,
+            .vertex_buffers = vertex_buffers,
+            .vertex_offsets = vertex_offsets,
+            .descriptor_set = descriptor_set,
+            .indirect_buffer = frame.indirect_buffer.get(),
+            .indirect_offset = indirect_offset,
+            .count_offset = count_offset,
+            .draw_count = draw_count,
+        });
+
+        batch.pipeline = VK_NULL_HANDLE;
+        for (auto& data : batch.vertex_data)
+            data.clear();
+        batch.vertex_count = 0;
+        batch.commands.clear();
+        batch.draw_data.clear();
+        batch.bounding_spheres.clear();
+    }
+
+    // batches are only continued by draws that can share their state
+    template<class Info>
+    bool batch_compatible(
+        const draw_batch& batch, VkPipeline pipeline, const Info& info,
+        span<const VkDescriptorImageInfo> images,
+        span<const VkDescriptorBufferInfo> storage_buffers,
+        span<const VkVertexInputBindingDescription> bindings,
+        span<const VkVertexInputAttributeDescription> attributes
+    ) {
+        auto same_bytes = [](auto a, auto b) {
+            return 
+                a.size() == b.size() && 
+                memcmp(a.data(), b.data(), a.size_bytes()) == 0;
+        };
+        auto same_image = [](
+            const VkDescriptorImageInfo& a, const VkDescriptorImageInfo& b
+        ) {
+            return 
+                a.sampler == b.sampler && a.imageView == b.imageView &&
+                a.imageLayout == b.imageLayout;
+        };
+        return 
+            batch.pipeline == pipeline && 
+            batch.topology == info.topology &&
+            batch.draw_data_size == info.uniform_source_size &&
+            ranges::equal(batch.images, images, same_image) &&
+            same_bytes(span(batch.storage_buffers), storage_buffers) &&
+            batch.culled == info.culling.has_value() &&
+            (
+                !batch.culled || 
+                batch.frustum_planes == info.culling->frustum_planes
+            ) &&
+            same_bytes(span(batch.vertex_bindings), bindings) &&
+            same_bytes(span(batch.vertex_attributes), attributes);
+    }
+
+    template<class Info>
+    void add_to_batch(
+        renderer_data& r, imv::frame& frame, imv::pass& pass,
+        const program& program, VkPipeline pipeline, const Info& info,
+        span<const VkDescriptorImageInfo> images,
+        span<const VkDescriptorBufferInfo> storage_buffers,
+        span<const VkVertexInputBindingDescription> bindings,
+        span<const VkVertexInputAttributeDescription> attributes
+    ) {
+        if (program.uniform_size > 0 || program.push_constant_range.size > 0)
+            throw std::runtime_error("batched draws need a storage block");
+        auto& batch = pass.batch;
+        if (
+            !batch_compatible(
+                batch, pipeline, info, images, storage_buffers, bindings, 
+                attributes
+            ) ||
+            batch.commands.size() == r.max_draw_indirect_count
+        ) {
+            flush_batch(r, frame, pass);
+            for (const auto& binding : bindings) {
+                if (binding.inputRate != VK_VERTEX_INPUT_RATE_VERTEX) {
+                    throw std::runtime_error(
+                        "batched draws can't have per instance bindings"
+                    );
+                }
+            }
+            batch.pipeline = pipeline;
+            batch.program = &program;
+            batch.topology = info.topology;
+            batch.draw_data_size = info.uniform_source_size;
+            batch.vertex_bindings.assign(bindings.begin(), bindings.end());
+            batch.vertex_attributes.assign(
+                attributes.begin(), attributes.end()
+            );
+            batch.images.assign(images.begin(), images.end());
+            batch.storage_buffers.assign(
+                storage_buffers.begin(), storage_buffers.end()
+            );
+            batch.vertex_data.resize(bindings.size());
+            batch.culled = info.culling.has_value();
+            if (batch.culled)
+                batch.frustum_planes = info.culling->frustum_planes;
+        }
+
+        // consecutive draws of the same vertices share them
+        bool same_vertices = 
+            !batch.commands.empty() && 
+            batch.commands.back().vertexCount == info.vertex_count;
+        for (size_t i = 0; i < bindings.size() && same_vertices; i++) {
+            auto& source = *(info.vertex_input_bindings.begin() + i);
+            auto size = std::min<size_t>(
+                source.buffer_source_size, 
+                size_t(info.vertex_count) * bindings[i].stride
+            );
+            auto previous = 
+                size_t(batch.commands.back().firstVertex) * bindings[i].stride;
+            same_vertices = memcmp(
+                batch.vertex_data[i].data() + previous, 
+                source.buffer_source_pointer, size
+            ) == 0;
+        }
+
+        uint32_t first_vertex = batch.vertex_count;
+        if (same_vertices) {
+            first_vertex = batch.commands.back().firstVertex;
+        } else {
+            for (size_t i = 0; i < bindings.size(); i++) {
+                auto& source = *(info.vertex_input_bindings.begin() + i);
+                auto stride = bindings[i].stride;
+                auto size = std::min<size_t>(
+                    source.buffer_source_size, 
+                    size_t(info.vertex_count) * stride
+                );
+                // padded, so all bindings start at the same vertex
+                auto& data = batch.vertex_data[i];
+                data.resize(size_t(first_vertex + info.vertex_count) * stride);
+                memcpy(
+                    data.data() + size_t(first_vertex) * stride, 
+                    source.buffer_source_pointer, size
+                );
+            }
+            batch.vertex_count += info.vertex_count;
+        }
+
+        batch.commands.push_back({
+            .vertexCount = info.vertex_count,
+            .instanceCount = 1,
+            .firstVertex = first_vertex,
+            .firstInstance = 0,
+        });
+        if (batch.culled)
+            batch.bounding_spheres.push_back(info.culling->bounding_sphere);
+        if (program.draw_data) {
+            auto data = 
+                static_cast<const std::byte*>(info.uniform_source_pointer);
+            batch.draw_data.insert(
+                batch.draw_data.end(), data, data + info.uniform_source_size
+            );
+        }
+    }
+
+    template<class Info>
+    bool draw(renderer_data& r, const Info& info) {
+        // preparing doesn't need a frame, so it also works before the first
+        // wait_frame
+        if (!r.recording && !info.prepare_only)
+            return false;
+
+        // nothing allocated from scratch outlives a draw
+        r.scratch.reset();
+
+        // pipelines are created for the pass being recorded
+        imv::pass* pass = nullptr;
+        if (r.recording) {
+            auto& frame = r.frames[r.frame_index];
+            pass = &frame.passes[frame.current_pass];
+        }
+
+        pmr::vector<VkPipelineShaderStageCreateInfo> pipeline_shader_stages(
+            info.stages.size(), r.scratch.get()
+        );
+        pmr::vector<const shader_reflection*> reflections(
+            info.stages.size(), r.scratch.get()
+        );
+        pmr::vector<shared_ptr<unique_shader_module>> shader_modules(
+            info.stages.size(), r.scratch.get()
+        );
+        pmr::vector<hash128> hashes(info.stages.size(), r.scratch.get());
+        pmr::vector<VkSpecializationInfo> specializations(
+            info.stages.size(), r.scratch.get()
+        );
+
+        for (auto i = 0u; i < info.stages.size(); i++) {
+            auto& stage = *(info.stages.begin() + i);
+            auto& shader = load_shader(r, stage.code_file_name);
+            VkPipelineShaderStageCreateInfo create_info = stage.info;
+            create_info.sType = 
+                VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            create_info.module = shader.shader_module->get();
+            if (create_info.pName == nullptr)
+                create_info.pName = "main";
+            create_info.pSpecializationInfo = nullptr;
+            if (size(stage.specialization_entries) > 0) {
+                specializations[i] = {
+                    .mapEntryCount = 
+                        uint32_t(size(stage.specialization_entries)),
+                    .pMapEntries = data(stage.specialization_entries),
+                    .dataSize = stage.specialization_data_size,
+                    .pData = stage.specialization_data,
+                };
+                create_info.pSpecializationInfo = &specializations[i];
+            }
+            pipeline_shader_stages[i] = create_info;
+            reflections[i] = &shader.reflection;
+            shader_modules[i] = shader.shader_module;
+            hashes[i] = shader.hash;
+        }
+
+        auto& program = get_program(
+            r, pipeline_shader_stages, reflections, hashes
+        );
+
+        pmr::vector<VkDescriptorImageInfo> descriptor_image_info(
+            r.scratch.get()
+        );
+        for (const auto& image : info.images) {
+            VkImageView view = VK_NULL_HANDLE;
+            if (image.render_target.empty()) {
+                auto& file = load_image(r, image.file_name);
+                view = file.view ? file.view->get() : VK_NULL_HANDLE;
+            } else if (!info.prepare_only) {
+                auto& target = read_render_target(r, image.render_target);
+                for (auto& attachment : pass->attachments) {
+                    if (attachment.target == &target) {
+                        throw std::runtime_error(
+                            "a pass can't sample its own attachments"
+                        );
+                    }
+                }
+                if (ranges::find(pass->sampled, &target) == end(pass->sampled))
+                    pass->sampled.push_back(&target);
+                view = target.view->get();
+            }
+            descriptor_image_info.push_back({
+                .sampler = get_sampler(r, image.sampler_info),
+                .imageView = view,
+                .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            });
+        }
+
+        pmr::vector<VkVertexInputBindingDescription> 
+            vertex_input_binding_descriptions(r.scratch.get());
+        pmr::vector<VkVertexInputAttributeDescription> 
+            vertex_input_attribute_description(r.scratch.get());
+        for (const auto& binding : info.vertex_input_bindings) {
+            vertex_input_binding_descriptions.push_back(binding.description);
             for (const auto& attribute : binding.attributes) {
                 vertex_input_attribute_description.push_back(attribute);
             }
@@ -904,25 +3686,14 @@ namespace imv {
         VkPipelineInputAssemblyStateCreateInfo pipeline_input_assembly_state = {
             .sType =
                 VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-            .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP,
+            .topology = r.features.extended_dynamic_state ? 
+                topology_class(info.topology) : info.topology,
             .primitiveRestartEnable = VK_FALSE,
         };
-        VkViewport viewport = {
-            .x = 0.0f, .y = 0.0f,
-            .width = float(view.extent.width), 
-            .height = float(view.extent.height),
-            .minDepth = 0.0f, .maxDepth = 1.0f,
-        };
-        VkRect2D scissor = {
-            .offset = {0, 0}, 
-            .extent = {view.extent.width, view.extent.height},
-        };
         VkPipelineViewportStateCreateInfo pipeline_viewport_state = {
             .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
             .viewportCount = 1,
-            .pViewports = &viewport,
             .scissorCount = 1,
-            .pScissors = &scissor,
         };
         VkPipelineRasterizationStateCreateInfo 
         pipeline_rasterization_state = {
@@ -953,188 +3724,1396 @@ namespace imv {
             .pAttachments = pipeline_color_blend_attachment_states.begin(),
             .blendConstants = {0.0f, 0.0f, 0.0f, 0.0f},
         };
+        VkPipelineDepthStencilStateCreateInfo pipeline_depth_stencil_state = {
+            .sType = 
+                VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+            .depthTestEnable = info.depth_test,
+            .depthWriteEnable = info.depth_test && info.depth_write,
+            .depthCompareOp = info.depth_compare,
+            .minDepthBounds = 0.0f,
+            .maxDepthBounds = 1.0f,
+        };
+        bool depth = pass ? 
+            pass->depth : r.depth_format != VK_FORMAT_UNDEFINED;
+        // prepared pipelines without a pass are for the window
+        VkFormat window_format = r.surface_format.format;
+        VkPipelineRenderingCreateInfoKHR rendering_info = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
+            .colorAttachmentCount = 
+                pass ? uint32_t(pass->color_formats.size()) : 1u,
+            .pColorAttachmentFormats = 
+                pass ? pass->color_formats.data() : &window_format,
+            .depthAttachmentFormat = 
+                depth ? r.depth_format : VK_FORMAT_UNDEFINED,
+        };
+        pmr::vector<VkDynamicState> dynamic_states(
+            { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR, }, 
+            r.scratch.get()
+        );
+        if (r.features.extended_dynamic_state) {
+            dynamic_states.push_back(VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT);
+        }
+        if (r.features.vertex_input_dynamic_state) {
+            dynamic_states.push_back(VK_DYNAMIC_STATE_VERTEX_INPUT_EXT);
+        }
+        VkPipelineDynamicStateCreateInfo pipeline_dynamic_state = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+            .dynamicStateCount = uint32_t(dynamic_states.size()),
+            .pDynamicStates = dynamic_states.data(),
+        };
         VkGraphicsPipelineCreateInfo create_info = {
             .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-            .stageCount = uint32_t(r.pipeline_shader_stages.size()),
-            .pStages = r.pipeline_shader_stages.data(),
-            .pVertexInputState = &pipeline_vertex_input_state,
+            .pNext = r.features.dynamic_rendering ? &rendering_info : nullptr,
+            .stageCount = uint32_t(pipeline_shader_stages.size()),
+            .pStages = pipeline_shader_stages.data(),
+            // ignored when the vertex input is dynamic
+            .pVertexInputState = r.features.vertex_input_dynamic_state ? 
+                nullptr : &pipeline_vertex_input_state,
             .pInputAssemblyState = &pipeline_input_assembly_state,
             .pViewportState = &pipeline_viewport_state,
             .pRasterizationState = &pipeline_rasterization_state,
             .pMultisampleState = &pipeline_multisample_state,
+            // only part of the key with a depth attachment
+            .pDepthStencilState = 
+                depth ? &pipeline_depth_stencil_state : nullptr,
             .pColorBlendState = &pipeline_color_blend_state,
-            .layout = pipeline_layout,
-            .renderPass = r.render_pass.get(),
+            .pDynamicState = &pipeline_dynamic_state,
+            .layout = program.pipeline_layout,
+            .renderPass = pass ? pass->render_pass : r.render_pass.get(),
         };
-        check(vkCreateGraphicsPipelines(
-            r.device.get(), r.pipeline_cache.get(), 1, &create_info, nullptr,
-            out_ptr(image.pipelines.back())
-        ));
 
-        {
-            // TODO: may need a separate pool per pipeline layout
-            unsigned max_draw_count = 1024; // TODO: grow
-            vector<VkDescriptorPoolSize> pool_size = {
-                {
-                    .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                    .descriptorCount = 1,
-                },
-            };
-            for (auto& _ : info.images) {
-                pool_size.push_back({
-                    .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                    .descriptorCount = 1,
-                });
-            }
-            VkDescriptorPoolCreateInfo create_info = {
-                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-                .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT ,
-                .maxSets = view.image_count * max_draw_count,
-                .poolSizeCount = uint32_t(size(pool_size)),
-                .pPoolSizes = pool_size.data(),
-            };
+        auto [compiled, inserted] = 
+            r.pipelines.try_emplace(create_info, code_hashes{hashes});
+        if (inserted) {
+            packaged_task<unique_pipeline()> compile(
+                [
+                    device = r.device.get(), 
+                    cache = r.pipeline_cache.get(), 
+                    state = make_unique<pipeline_state>(
+                        create_info, shader_modules
+                    )
+                ] {
+                    unique_pipeline pipeline;
+                    check(vkCreateGraphicsPipelines(
+                        device, cache, 1, &state->create_info, nullptr, 
+                        owned_out_ptr(pipeline, device)
+                    ));
+                    return pipeline;
+                }
+            );
+            *compiled = compile.get_future().share();
+            // with libraries, blocking draws link a pipeline instead
+            if (
+                info.compile == compile_policy::block && 
+                !r.features.graphics_pipeline_library
+            ) {
+                compile();
+            } else {
+                r.compile_threads->submit(std::move(compile));
+            }
+        }
 
-            vector<uint64_t> key;
-            visit(key, create_info);
-            auto insert = r.descriptor_pools.insert({key, {}});
-            if (insert.second) {
-                check(vkCreateDescriptorPool(
-                    r.device.get(), &create_info, nullptr, 
-                    out_ptr(insert.first->second))
+        if (info.prepare_only) {
+            // preparing waits for the optimized pipeline, not a linked one
+            if (
+                info.compile == compile_policy::block || 
+                compiled->wait_for(0s) == future_status::ready
+            ) {
+                compiled_pipeline(
+                    r.pipelines, *compiled, create_info, code_hashes{hashes}
                 );
+                return true;
             }
-            VkDescriptorPool descriptor_pool = insert.first->second.get();
-            
-            image.descriptor_sets.push_back({{}, {descriptor_pool}});
-            VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {
-                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-                .descriptorPool = descriptor_pool,
-                .descriptorSetCount = 1,
-                .pSetLayouts = &descriptor_set_layout,
-            };
-            check(vkAllocateDescriptorSets(
-                r.device.get(), &descriptor_set_allocate_info, 
-                out_ptr(image.descriptor_sets.back())
-            ));
+            return false;
         }
-        VkDescriptorBufferInfo descriptor_buffer_info[] = {
-            {
-                .buffer = image.uniform_buffer.get(),
-                .offset = image.uniform_buffer_size,
-                .range = uniform_size,
+
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        bool block = info.compile == compile_policy::block;
+        if (compiled->wait_for(0s) == future_status::ready) {
+            pipeline = compiled_pipeline(
+                r.pipelines, *compiled, create_info, code_hashes{hashes}
+            );
+            // the linked pipeline only lives until the frames drawing with
+            // it finished
+            if (r.linked_pipelines.size() > 0) {
+                code_hashes key{hashes};
+                if (auto linked = r.linked_pipelines.find(create_info, key)) {
+                    retire(r, std::move(*linked));
+                    r.linked_pipelines.erase(create_info, key);
+                }
             }
+        } else if (r.features.graphics_pipeline_library) {
+            // until the optimized pipeline is compiled in the background, 
+            // once the libraries are compiled unless blocking
+            pipeline = link_pipeline(
+                r, create_info, hashes, shader_modules, block
+            );
+        } else if (block) {
+            pipeline = compiled_pipeline(
+                r.pipelines, *compiled, create_info, code_hashes{hashes}
+            );
+        }
+        if (!pipeline) {
+            if (
+                info.compile == compile_policy::fallback && 
+                size(info.fallback_stages) > 0
+            ) {
+                // drawing recursively resets the scratch arena, so nothing
+                // from this draw is used afterwards
+                Info fallback = info;
+                fallback.stages = info.fallback_stages;
+                fallback.fallback_stages = {};
+                fallback.compile = compile_policy::block;
+                return draw(r, fallback);
+            }
+            return false;
+        }
+
+        imv::frame& frame = r.frames[r.frame_index];
+
+        create_host_buffer(
+            r, frame.vertex_buffer_capacity, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            frame.vertex_buffer, frame.vertex_allocation
+        );
+
+        // the draw data block comes first
+        pmr::vector<VkDescriptorBufferInfo> storage_buffers(r.scratch.get());
+        if (program.draw_data)
+            storage_buffers.emplace_back();
+        for (const auto& buffer : info.storage_buffers)
+            storage_buffers.push_back(get_storage_buffer(r, frame, buffer));
+
+        if (info.batch && r.features.multi_draw_indirect) {
+            add_to_batch(
+                r, frame, *pass, program, pipeline, info, 
+                descriptor_image_info, 
+                span(storage_buffers).subspan(program.draw_data ? 1 : 0),
+                vertex_input_binding_descriptions, 
+                vertex_input_attribute_description
+            );
+            return true;
+        }
+        // keeps the order of draws
+        flush_batch(r, frame, *pass);
+
+        pmr::vector<VkBuffer> vertex_buffers(r.scratch.get());
+        pmr::vector<VkDeviceSize> vertex_offsets(r.scratch.get());
+        for (const auto& binding : info.vertex_input_bindings) {
+            check(vmaCopyMemoryToAllocation(
+                r.allocator.get(), binding.buffer_source_pointer, 
+                frame.vertex_allocation.get(), 
+                frame.vertex_buffer_size, binding.buffer_source_size
+            ));
+            vertex_buffers.push_back(frame.vertex_buffer.get());
+            vertex_offsets.push_back(frame.vertex_buffer_size);
+            frame.vertex_buffer_size += binding.buffer_source_size;
+        }
+
+        if (program.draw_data) {
+            storage_buffers[0] = write_draw_data(
+                r, frame, info.uniform_source_pointer, info.uniform_source_size
+            );
+        }
+        auto uniforms = write_uniforms(
+            r, frame, program, 
+            info.uniform_source_pointer, info.uniform_source_size
+        );
+        auto descriptor_set = allocate_descriptor_set(
+            r, frame, program, uniforms, storage_buffers, 
+            descriptor_image_info
+        );
+
+        pmr::vector<VkVertexInputBindingDescription2EXT> bindings(
+            r.scratch.get()
+        );
+        pmr::vector<VkVertexInputAttributeDescription2EXT> attributes(
+            r.scratch.get()
+        );
+        if (r.features.vertex_input_dynamic_state) {
+            dynamic_vertex_input(
+                vertex_input_binding_descriptions, 
+                vertex_input_attribute_description, 
+                bindings, attributes
+            );
+        }
+
+        auto push_constants = push_constant_data(
+            program, info.uniform_source_pointer, info.uniform_source_size
+        );
+
+        draw_commands commands = {
+            .pipeline = pipeline,
+            .pipeline_layout = program.pipeline_layout,
+            .topology = info.topology,
+            .vertex_bindings = bindings,
+            .vertex_attributes = attributes,
+            .vertex_buffers = vertex_buffers,
+            .vertex_offsets = vertex_offsets,
+            .descriptor_set = descriptor_set,
+            .push_constant_stages = program.push_constant_range.stageFlags,
+            .push_constants = push_constants,
+            .vertex_count = info.vertex_count,
         };
-        vector<VkWriteDescriptorSet> write_descriptor_set = {
-            {
-                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                .dstSet = image.descriptor_sets.back().get(),
-                .dstBinding = 0,
-                .dstArrayElement = 0,
-                .descriptorCount = uint32_t(size(descriptor_buffer_info)),
-                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                .pBufferInfo = descriptor_buffer_info,
-            },
+        if (info.depth_key) {
+            pass->deferred_draws.push_back(*info.depth_key, commands);
+        } else {
+            record_draw(r, pass->command_buffer, commands);
+        }
+
+        return true;
+    }
+
+    template<class Info>
+    bool dispatch(renderer_data& r, const Info& info) {
+        if (!r.recording)
+            return false;
+
+        // nothing allocated from scratch outlives a dispatch
+        r.scratch.reset();
+
+        auto& shader = load_shader(r, info.stage.code_file_name);
+        VkPipelineShaderStageCreateInfo stage = info.stage.info;
+        stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        stage.module = shader.shader_module->get();
+        if (stage.pName == nullptr)
+            stage.pName = "main";
+        stage.pSpecializationInfo = nullptr;
+        VkSpecializationInfo specialization;
+        if (size(info.stage.specialization_entries) > 0) {
+            specialization = {
+                .mapEntryCount = 
+                    uint32_t(size(info.stage.specialization_entries)),
+                .pMapEntries = data(info.stage.specialization_entries),
+                .dataSize = info.stage.specialization_data_size,
+                .pData = info.stage.specialization_data,
+            };
+            stage.pSpecializationInfo = &specialization;
+        }
+        const shader_reflection* reflection = &shader.reflection;
+        auto& program = get_program(
+            r, span(&stage, 1), span(&reflection, 1), span(&shader.hash, 1)
+        );
+
+        VkComputePipelineCreateInfo create_info = {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = stage,
+            .layout = program.pipeline_layout,
         };
-        vector<VkDescriptorImageInfo> descriptor_image_info;
-        for (int i = 0; i < info.images.size(); i++) {
-            descriptor_image_info.push_back({
-                .sampler = image.samplers.back().get(),
-                .imageView = image.image_views[first_image_view + i]->get(),
-                .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        auto pipeline = 
+            get_compute_pipeline(r, create_info, shader, info.compile);
+        if (!pipeline)
+            return false;
+
+        imv::frame& frame = r.frames[r.frame_index];
+        pmr::vector<VkDescriptorBufferInfo> storage_buffers(r.scratch.get());
+        for (const auto& buffer : info.storage_buffers)
+            storage_buffers.push_back(get_storage_buffer(r, frame, buffer));
+        auto uniforms = write_uniforms(
+            r, frame, program, 
+            info.uniform_source_pointer, info.uniform_source_size
+        );
+        auto descriptor_set = allocate_descriptor_set(
+            r, frame, program, uniforms, storage_buffers, {}
+        );
+        record_dispatch(
+            r, frame, pipeline, program, descriptor_set, 
+            push_constant_data(
+                program, info.uniform_source_pointer, info.uniform_source_size
+            ),
+            info.group_count_x, info.group_count_y, info.group_count_z
+        );
+        return true;
+    }
+
+    template<class Info>
+    void begin_pass(renderer_data& r, const Info& info) {
+        if (!r.recording)
+            return;
+        imv::frame& frame = r.frames[r.frame_index];
+        if (frame.current_pass != 0)
+            throw std::runtime_error("begin_pass called before end_pass");
+
+        r.scratch.reset();
+
+        VkExtent2D extent = info.extent;
+        if (extent.width == 0 || extent.height == 0)
+            extent = frame.view->extent;
+
+        auto pass = recycled_pass(frame);
+        pmr::vector<VkAttachmentDescription> descriptions(r.scratch.get());
+        for (const auto& attachment : info.color_attachments) {
+            auto entry = r.render_targets.find(attachment.name);
+            if (entry == r.render_targets.end()) {
+                entry = r.render_targets.emplace(
+                    attachment.name, render_target{}
+                ).first;
+            }
+            auto& target = entry->second;
+            if (attachment.load) {
+                if (target.drawn_frame != r.frame_number)
+                    target.persistent = true;
+                target.read = true;
+            }
+            if (
+                !target.image || target.format != attachment.format ||
+                target.extent.width != extent.width || 
+                target.extent.height != extent.height ||
+                (target.read && target.transient)
+            ) {
+                create_render_target(r, target, attachment.format, extent);
+            }
+            target.drawn_frame = r.frame_number;
+
+            pass.attachments.push_back({
+                .target = &target,
+                .load = attachment.load,
+                .clear_value = { .color = attachment.clear_color },
+            });
+            pass.color_formats.push_back(attachment.format);
+            descriptions.push_back({
+                .format = attachment.format,
+                .samples = VK_SAMPLE_COUNT_1_BIT,
+                .loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                .finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
             });
         }
 
-        for (unsigned i = 0; i < info.images.size(); i++) {
-            write_descriptor_set.push_back({
-                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                .dstSet = image.descriptor_sets.back().get(),
-                .dstBinding = 1 + i,
-                .dstArrayElement = 0,
-                .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                .pImageInfo = &descriptor_image_info[i],
+        pass.extent = extent;
+        pass.render_pass = r.features.dynamic_rendering ? 
+            VK_NULL_HANDLE : offscreen_render_pass(r, descriptions);
+        add_pass(r, frame, std::move(pass));
+    }
+
+    // records the draws with a depth key front to back, before the other 
+    // draws of the pass, so early depth testing discards hidden fragments
+    void record_deferred_draws(
+        renderer_data& r, imv::frame& frame, imv::pass& pass
+    ) {
+        auto& deferred = pass.deferred_draws;
+        if (deferred.draws.empty())
+            return;
+        ranges::stable_sort(deferred.draws, {}, &deferred_draw::depth_key);
+        pass.sorted_command_buffer = begin_pass_commands(r, frame, pass);
+        for (const auto& draw : deferred.draws)
+            record_draw(r, pass.sorted_command_buffer, deferred.get(draw));
+        check(vkEndCommandBuffer(pass.sorted_command_buffer));
+        pass.deferred_draws.clear();
+    }
+
+    void end_pass(renderer_data& r) {
+        if (!r.recording)
+            return;
+        imv::frame& frame = r.frames[r.frame_index];
+        if (frame.current_pass == 0)
+            throw std::runtime_error("end_pass called before begin_pass");
+        auto& pass = frame.passes[frame.current_pass];
+        flush_batch(r, frame, pass);
+        record_deferred_draws(r, frame, pass);
+        check(vkEndCommandBuffer(pass.command_buffer));
+        frame.current_pass = 0;
+    }
+
+    // a barrier for the first level and layer of an image
+    VkImageMemoryBarrier layout_barrier(
+        VkImage image, VkImageAspectFlags aspect, 
+        VkImageLayout old_layout, VkImageLayout new_layout,
+        VkAccessFlags source_access, VkAccessFlags destination_access
+    ) {
+        return {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = source_access,
+            .dstAccessMask = destination_access,
+            .oldLayout = old_layout,
+            .newLayout = new_layout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = image,
+            .subresourceRange = {
+                .aspectMask = aspect,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        };
+    }
+
+    // records the render pass, or the dynamic rendering, executing a pass.
+    // Attachments are stored if a pass submitted after it reads them
+    void record_pass(renderer_data& r, imv::frame& frame, size_t index) {
+        auto& pass = frame.passes[index];
+
+        // targets sampled without having been stored have undefined 
+        // contents, but still need to be in the right layout
+        pmr::vector<VkImageMemoryBarrier> barriers(r.scratch.get());
+        for (auto target : pass.sampled) {
+            if (target->layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+                continue;
+            barriers.push_back({
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .srcAccessMask = 0,
+                .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+                .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = target->image->get(),
+                .subresourceRange = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .baseMipLevel = 0,
+                    .levelCount = 1,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
             });
+            target->layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        }
+        auto shader_stages = 
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | 
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        if (!barriers.empty()) {
+            vkCmdPipelineBarrier(
+                frame.command_buffer, 
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | shader_stages,
+                shader_stages, 0, 0, nullptr, 0, nullptr, 
+                uint32_t(barriers.size()), barriers.data()
+            );
         }
-        vkUpdateDescriptorSets(
-            r.device.get(), 
-            size(write_descriptor_set), data(write_descriptor_set), 0, nullptr
-        );
 
-        vkCmdBindPipeline(
-            image.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-            image.pipelines.back().get()
+        bool dynamic = r.features.dynamic_rendering;
+        VkRenderPass render_pass = VK_NULL_HANDLE;
+        VkFramebuffer framebuffer = VK_NULL_HANDLE;
+        pmr::vector<VkClearValue> clear_values(r.scratch.get());
+        // with dynamic rendering, barriers transition the layouts instead of
+        // the render pass
+        pmr::vector<VkRenderingAttachmentInfoKHR> color_attachments(
+            r.scratch.get()
         );
+        VkRenderingAttachmentInfoKHR depth_attachment = {};
+        pmr::vector<VkImageMemoryBarrier> begin_barriers(r.scratch.get());
+        pmr::vector<VkImageMemoryBarrier> end_barriers(r.scratch.get());
+        VkPipelineStageFlags begin_source_stages = 0;
+        VkPipelineStageFlags begin_destination_stages = 0;
+        VkPipelineStageFlags end_destination_stages = 0;
+        if (index == 0) {
+            auto& view = *frame.view;
+            auto& image = view.images[view.image_index];
+            clear_values.push_back({ .color = {{0.0f, 0.0f, 0.0f, 1.0f}} });
+            if (pass.depth)
+                clear_values.push_back({ .depthStencil = { 1.0f, 0 } });
+            if (!dynamic) {
+                render_pass = r.render_pass.get();
+                framebuffer = image.swapchain_framebuffer.get();
+            } else {
+                auto swapchain_image = view.swapchain_images[view.image_index];
+                color_attachments.push_back({
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+                    .imageView = image.swapchain_image_view.get(),
+                    .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                    .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                    .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                    .clearValue = clear_values[0],
+                });
+                begin_barriers.push_back(layout_barrier(
+                    swapchain_image, VK_IMAGE_ASPECT_COLOR_BIT,
+                    VK_IMAGE_LAYOUT_UNDEFINED, 
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                    0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+                ));
+                end_barriers.push_back(layout_barrier(
+                    swapchain_image, VK_IMAGE_ASPECT_COLOR_BIT,
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                    VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0
+                ));
+                // the depth image is reused by the next frame drawing to
+                // the swapchain image
+                begin_source_stages = 
+                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                    VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+                begin_destination_stages = 
+                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+                end_destination_stages = 
+                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+                if (pass.depth) {
+                    depth_attachment = {
+                        .sType = 
+                            VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+                        .imageView = image.depth_view.get(),
+                        .imageLayout = 
+                            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                        .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                        .clearValue = clear_values[1],
+                    };
+                    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+                    if (has_stencil(r.depth_format))
+                        aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+                    begin_barriers.push_back(layout_barrier(
+                        image.depth_image.get(), aspect,
+                        VK_IMAGE_LAYOUT_UNDEFINED,
+                        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+                    ));
+                }
+            }
+        } else {
+            // passes are submitted in order, followed by the window's
+            auto read_later = [&](render_target* target) {
+                for (size_t i = index + 1; i <= frame.passes.size(); i++) {
+                    auto& later = frame.passes[i % frame.passes.size()];
+                    auto& sampled = later.sampled;
+                    if (ranges::find(sampled, target) != end(sampled))
+                        return true;
+                    for (auto& attachment : later.attachments) {
+                        if (attachment.target == target && attachment.load)
+                            return true;
+                    }
+                }
+                return false;
+            };
+
+            pmr::vector<VkAttachmentDescription> descriptions(
+                r.scratch.get()
+            );
+            pmr::vector<VkImageView> views(r.scratch.get());
+            for (auto& attachment : pass.attachments) {
+                auto& target = *attachment.target;
+                bool load = 
+                    attachment.load && 
+                    target.layout != VK_IMAGE_LAYOUT_UNDEFINED;
+                bool store = target.persistent || read_later(&target);
+                auto load_op = 
+                    load ? VK_ATTACHMENT_LOAD_OP_LOAD :
+                    attachment.load ? VK_ATTACHMENT_LOAD_OP_DONT_CARE :
+                    VK_ATTACHMENT_LOAD_OP_CLEAR;
+                auto store_op = store ? 
+                    VK_ATTACHMENT_STORE_OP_STORE : 
+                    VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                auto initial_layout = 
+                    load ? target.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+                if (!dynamic) {
+                    descriptions.push_back({
+                        .format = target.format,
+                        .samples = VK_SAMPLE_COUNT_1_BIT,
+                        .loadOp = load_op,
+                        .storeOp = store_op,
+                        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                        .initialLayout = initial_layout,
+                        .finalLayout = store ? 
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL :
+                            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                    });
+                } else {
+                    color_attachments.push_back({
+                        .sType = 
+                            VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+                        .imageView = target.view->get(),
+                        .imageLayout = 
+                            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                        .loadOp = load_op,
+                        .storeOp = store_op,
+                        .clearValue = attachment.clear_value,
+                    });
+                    // the same dependencies as offscreen render passes
+                    begin_barriers.push_back(layout_barrier(
+                        target.image->get(), VK_IMAGE_ASPECT_COLOR_BIT,
+                        initial_layout, 
+                        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | 
+                            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+                    ));
+                    if (store) {
+                        end_barriers.push_back(layout_barrier(
+                            target.image->get(), VK_IMAGE_ASPECT_COLOR_BIT,
+                            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                            VK_ACCESS_SHADER_READ_BIT |
+                                VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | 
+                                VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+                        ));
+                    }
+                }
+                target.layout = store ? 
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : 
+                    VK_IMAGE_LAYOUT_UNDEFINED;
+                views.push_back(target.view->get());
+                clear_values.push_back(attachment.clear_value);
+            }
+            begin_source_stages = 
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | shader_stages;
+            begin_destination_stages = 
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            end_destination_stages = 
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | shader_stages;
+
+            if (!dynamic) {
+                render_pass = offscreen_render_pass(r, descriptions);
+
+                auto [cached, inserted] = r.framebuffers.try_emplace(
+                    render_pass, pass.extent.width, pass.extent.height,
+                    span<const VkImageView>(views)
+                );
+                if (inserted) {
+                    VkFramebufferCreateInfo create_info = {
+                        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+                        .renderPass = render_pass,
+                        .attachmentCount = uint32_t(views.size()),
+                        .pAttachments = views.data(),
+                        .width = pass.extent.width,
+                        .height = pass.extent.height,
+                        .layers = 1,
+                    };
+                    check(vkCreateFramebuffer(
+                        r.device.get(), &create_info, nullptr,
+                        owned_out_ptr(*cached, r.device.get())
+                    ));
+                }
+                framebuffer = cached->get();
+            }
+        }
 
-        vkCmdBindVertexBuffers(
-            image.command_buffer, 0, size(info.vertex_input_bindings), 
-            data(vertex_buffers), data(vertex_offsets)
+        VkCommandBuffer command_buffers[] = {
+            pass.sorted_command_buffer, pass.command_buffer,
+        };
+        bool sorted = pass.sorted_command_buffer != VK_NULL_HANDLE;
+        if (!dynamic) {
+            VkRenderPassBeginInfo render_pass_begin_info = {
+                .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+                .renderPass = render_pass,
+                .framebuffer = framebuffer,
+                .renderArea = {
+                    .offset = {0, 0}, .extent = pass.extent,
+                },
+                .clearValueCount = uint32_t(clear_values.size()),
+                .pClearValues = clear_values.data(),
+            };
+            vkCmdBeginRenderPass(
+                frame.command_buffer, &render_pass_begin_info,
+                VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+            );
+            vkCmdExecuteCommands(
+                frame.command_buffer, sorted ? 2u : 1u, 
+                sorted ? command_buffers : command_buffers + 1
+            );
+            vkCmdEndRenderPass(frame.command_buffer);
+            return;
+        }
+
+        if (!begin_barriers.empty()) {
+            vkCmdPipelineBarrier(
+                frame.command_buffer, 
+                begin_source_stages, begin_destination_stages, 0, 
+                0, nullptr, 0, nullptr, 
+                uint32_t(begin_barriers.size()), begin_barriers.data()
+            );
+        }
+        VkRenderingInfoKHR rendering_info = {
+            .sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+            .flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT_KHR,
+            .renderArea = {
+                .offset = {0, 0}, .extent = pass.extent,
+            },
+            .layerCount = 1,
+            .colorAttachmentCount = uint32_t(color_attachments.size()),
+            .pColorAttachments = color_attachments.data(),
+            .pDepthAttachment = pass.depth ? &depth_attachment : nullptr,
+        };
+        r.functions.cmd_begin_rendering(frame.command_buffer, &rendering_info);
+        vkCmdExecuteCommands(
+            frame.command_buffer, sorted ? 2u : 1u, 
+            sorted ? command_buffers : command_buffers + 1
         );
+        r.functions.cmd_end_rendering(frame.command_buffer);
+        if (!end_barriers.empty()) {
+            vkCmdPipelineBarrier(
+                frame.command_buffer, 
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 
+                end_destination_stages, 0, 0, nullptr, 0, nullptr, 
+                uint32_t(end_barriers.size()), end_barriers.data()
+            );
+        }
+    }
 
-        auto descriptor_set = image.descriptor_sets.back().get();
-        vkCmdBindDescriptorSets(
-            image.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-            pipeline_layout, 0, 1, 
-            &descriptor_set, 0, nullptr
+    // copies the textures loaded since the last submit into the frame's
+    // staging buffer and records all their uploads, returns false if there
+    // was nothing to upload
+    bool record_uploads(renderer_data& r, imv::frame& frame) {
+        if (r.pending_uploads.empty())
+            return false;
+
+        // offsets must be a multiple of the texel block size and 4
+        auto staging_offset = [](size_t offset, ktxTexture2* texture) {
+            size_t alignment = lcm(
+                size_t(16), 
+                size_t(ktxTexture_GetElementSize(ktxTexture(texture)))
+            );
+            return (offset + alignment - 1) / alignment * alignment;
+        };
+
+        size_t staging_size = 0;
+        for (auto& upload : r.pending_uploads) {
+            auto texture = upload.texture.get();
+            for (auto level = 0u; level < texture->numLevels; level++) {
+                staging_size = staging_offset(staging_size, texture) + 
+                    ktxTexture_GetImageSize(ktxTexture(texture), level);
+            }
+        }
+
+        // grows to the largest batch and keeps its size
+        if (frame.staging_buffer_capacity < staging_size) {
+            auto capacity = std::max<size_t>(staging_size, 16 * 1024 * 1024);
+            frame.staging_buffer.reset();
+            frame.staging_allocation.reset();
+            VkBufferCreateInfo create_info {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = capacity,
+                .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            };
+            VmaAllocationCreateInfo allocation_create_info {
+                .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+                .usage = VMA_MEMORY_USAGE_AUTO,
+            };
+            check(vmaCreateBuffer(
+                r.allocator.get(), &create_info, &allocation_create_info,
+                owned_out_ptr(frame.staging_buffer, r.device.get()), 
+                owned_out_ptr(frame.staging_allocation, r.allocator.get()),
+                nullptr
+            ));
+            frame.staging_buffer_capacity = capacity;
+        }
+
+        vkResetCommandBuffer(frame.upload_command_buffer, 0);
+        VkCommandBufferBeginInfo begin_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
+        check(vkBeginCommandBuffer(frame.upload_command_buffer, &begin_info));
+
+        pmr::vector<VkImageMemoryBarrier> barriers(r.scratch.get());
+        for (auto& upload : r.pending_uploads) {
+            barriers.push_back({
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .srcAccessMask = 0,
+                .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = upload.image->get(),
+                .subresourceRange = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .baseMipLevel = 0,
+                    .levelCount = upload.texture->numLevels,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
+            });
+        }
+        vkCmdPipelineBarrier(
+            frame.upload_command_buffer, 
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 0, nullptr, 0, nullptr, 
+            uint32_t(barriers.size()), barriers.data()
         );
 
-        vkCmdDraw(image.command_buffer, info.vertex_count, 1, 0, 0);
+        size_t staging_size_used = 0;
+        pmr::vector<VkBufferImageCopy> regions(r.scratch.get());
+        for (auto& upload : r.pending_uploads) {
+            auto texture = upload.texture.get();
+            auto data = ktxTexture_GetData(ktxTexture(texture));
+            regions.clear();
+            for (auto level = 0u; level < texture->numLevels; level++) {
+                ktx_size_t offset;
+                check(ktxTexture_GetImageOffset(
+                    ktxTexture(texture), level, 0, 0, &offset
+                ));
+                auto size = ktxTexture_GetImageSize(ktxTexture(texture), level);
+                staging_size_used = staging_offset(staging_size_used, texture);
+                check(vmaCopyMemoryToAllocation(
+                    r.allocator.get(), data + offset, 
+                    frame.staging_allocation.get(), staging_size_used, size
+                ));
+                regions.push_back({
+                    .bufferOffset = staging_size_used,
+                    .imageSubresource = {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .mipLevel = level,
+                        .baseArrayLayer = 0,
+                        .layerCount = 1,
+                    },
+                    .imageExtent = {
+                        std::max(texture->baseWidth >> level, 1u),
+                        std::max(texture->baseHeight >> level, 1u),
+                        1,
+                    },
+                });
+                staging_size_used += size;
+            }
+            vkCmdCopyBufferToImage(
+                frame.upload_command_buffer, frame.staging_buffer.get(), 
+                upload.image->get(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                uint32_t(regions.size()), regions.data()
+            );
+        }
 
-        // TODO: store offset in uniform_buffer?
-        check(vmaCopyMemoryToAllocation(
-            r.allocator.get(), info.uniform_source_pointer, 
-            image.uniform_allocation.get(), 
-            image.uniform_buffer_size, info.uniform_source_size
-        ));
+        auto shader_stages = 
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | 
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        for (auto& barrier : barriers) {
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        }
+        if (!r.transfer_queue) {
+            vkCmdPipelineBarrier(
+                frame.upload_command_buffer, 
+                VK_PIPELINE_STAGE_TRANSFER_BIT, shader_stages,
+                0, 0, nullptr, 0, nullptr, 
+                uint32_t(barriers.size()), barriers.data()
+            );
+            check(vkEndCommandBuffer(frame.upload_command_buffer));
+        } else {
+            // the transfer queue releases the images to the graphics queue,
+            // which acquires them with the same barriers after waiting for 
+            // upload_finished_semaphore
+            for (auto& barrier : barriers) {
+                barrier.dstAccessMask = 0;
+                barrier.srcQueueFamilyIndex = r.transfer_queue_family;
+                barrier.dstQueueFamilyIndex = r.graphics_queue_family;
+            }
+            vkCmdPipelineBarrier(
+                frame.upload_command_buffer, 
+                VK_PIPELINE_STAGE_TRANSFER_BIT, 
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                0, 0, nullptr, 0, nullptr, 
+                uint32_t(barriers.size()), barriers.data()
+            );
+            check(vkEndCommandBuffer(frame.upload_command_buffer));
 
-        image.uniform_buffer_size += 
-            aligned(info.uniform_source_size, r.offset_alignment);
+            vkResetCommandBuffer(frame.acquire_command_buffer, 0);
+            check(vkBeginCommandBuffer(
+                frame.acquire_command_buffer, &begin_info
+            ));
+            for (auto& barrier : barriers) {
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            }
+            vkCmdPipelineBarrier(
+                frame.acquire_command_buffer, shader_stages, shader_stages,
+                0, 0, nullptr, 0, nullptr, 
+                uint32_t(barriers.size()), barriers.data()
+            );
+            check(vkEndCommandBuffer(frame.acquire_command_buffer));
+        }
 
+        // the images may be evicted or reloaded before the upload is done
+        for (auto& upload : r.pending_uploads) {
+            retire(r, std::move(upload.image));
+            retire(r, std::move(upload.allocation));
+        }
+        r.pending_uploads.clear();
         return true;
     }
 
-    void submit(renderer* renderer) {
-        renderer_data& r = *get(renderer).d;
-        auto& view = r.view;
-        if (!view.images)
+    void submit(renderer_data& r) {
+        if (!r.recording)
             return;
+        imv::frame& frame = r.frames[r.frame_index];
+        if (frame.current_pass != 0)
+            throw std::runtime_error("submit called before end_pass");
+        r.recording = false;
+        auto& view = *frame.view;
         imv::image& image = view.images[view.image_index];
 
-        vkCmdEndRenderPass(image.command_buffer);
+        r.scratch.reset();
+        flush_batch(r, frame, frame.passes[0]);
+        record_deferred_draws(r, frame, frame.passes[0]);
+        check(vkEndCommandBuffer(frame.passes[0].command_buffer));
+        VkCommandBufferBeginInfo begin_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
+        check(vkBeginCommandBuffer(frame.command_buffer, &begin_info));
+        if (frame.compute_command_buffer)
+            record_dispatches(frame);
+        for (size_t i = 1; i <= frame.passes.size(); i++)
+            record_pass(r, frame, i % frame.passes.size());
+        check(vkEndCommandBuffer(frame.command_buffer));
 
-        check(vkEndCommandBuffer(image.command_buffer));
+        // all textures loaded this frame are uploaded in one go, before the
+        // draws using them
+        bool uploading = record_uploads(r, frame);
+        bool transfer = uploading && r.transfer_queue;
+        if (transfer) {
+            auto upload_semaphore = frame.upload_finished_semaphore.get();
+            VkSubmitInfo submit_info = {
+                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                .commandBufferCount = 1,
+                .pCommandBuffers = &frame.upload_command_buffer,
+                .signalSemaphoreCount = 1,
+                .pSignalSemaphores = &upload_semaphore,
+            };
+            check(vkQueueSubmit(r.transfer_queue, 1, &submit_info, nullptr));
+        }
 
-        auto wait_semaphore = r.swapchain_image_ready_semaphore.get();
-        auto signal_semaphore = image.render_finished_semaphore.get();
-        VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        VkCommandBuffer command_buffers[] = { 
+            transfer ? 
+                frame.acquire_command_buffer : frame.upload_command_buffer, 
+            frame.command_buffer,
+        };
+        VkSemaphore wait_semaphores[] = {
+            frame.swapchain_image_ready_semaphore.get(),
+            frame.upload_finished_semaphore.get(),
+        };
+        // uploads don't need to wait for the swapchain image, and only 
+        // shaders wait for the transfer queue
+        VkPipelineStageFlags wait_stages[] = {
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | 
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        };
+        VkSemaphore signal_semaphores[] = {
+            image.render_finished_semaphore.get(), r.timeline.get(),
+        };
+        // values for binary semaphores are ignored
+        uint64_t wait_values[] = { 0, 0 };
+        frame.timeline_value = r.frame_number;
+        uint64_t signal_values[] = { 0, frame.timeline_value };
+        VkTimelineSemaphoreSubmitInfoKHR timeline_info = {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+            .waitSemaphoreValueCount = transfer ? 2u : 1u,
+            .pWaitSemaphoreValues = wait_values,
+            .signalSemaphoreValueCount = 2,
+            .pSignalSemaphoreValues = signal_values,
+        };
         VkSubmitInfo submitInfo = {
             .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &wait_semaphore,
-            .pWaitDstStageMask = &wait_stage,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &image.command_buffer,
-            .signalSemaphoreCount = 1,
-            .pSignalSemaphores = &signal_semaphore,
-        };
-        check(vkQueueSubmit(
-            r.graphics_queue, 1, &submitInfo,
-            image.render_finished_fence.get()
-        ));
+            .pNext = &timeline_info,
+            .waitSemaphoreCount = transfer ? 2u : 1u,
+            .pWaitSemaphores = wait_semaphores,
+            .pWaitDstStageMask = wait_stages,
+            .commandBufferCount = uploading ? 2u : 1u,
+            .pCommandBuffers = uploading ? 
+                command_buffers : command_buffers + 1,
+            .signalSemaphoreCount = 2,
+            .pSignalSemaphores = signal_semaphores,
+        };
+        check(vkQueueSubmit(r.graphics_queue, 1, &submitInfo, nullptr));
 
         auto swapchains = view.swapchain.get();
         VkPresentInfoKHR present_info{
             .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
             .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &signal_semaphore,
+            .pWaitSemaphores = &signal_semaphores[0],
             .swapchainCount = 1,
             .pSwapchains = &swapchains,
             .pImageIndices = &view.image_index,
         };
+        r.frame_index = (r.frame_index + 1) % r.frames_in_flight;
         VkResult result = vkQueuePresentKHR(r.present_queue, &present_info);
         if (result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR) {
-            std::exchange(view, {});
+            view.outdated = true;
             return;
         }
         check(result);
     }
+
+    // calls on a renderer with a render thread, copied into its queue
+    enum class command_type : uint32_t {
+        wait_frame, draw, dispatch, begin_pass, end_pass, submit, stop,
+    };
+
+    struct queued_command {
+        command_type type;
+        // points into the same record, null for calls without arguments
+        const void* object;
+    };
+
+    // the lists of the infos as spans into a record, hiding the empty 
+    // initializer lists of the base
+    struct queued_stage : stage_info {
+        span<const VkSpecializationMapEntry> specialization_entries;
+    };
+
+    struct queued_vertex_binding : vertex_binding_info {
+        span<const VkVertexInputAttributeDescription> attributes;
+    };
+
+    struct queued_draw : draw_info {
+        span<const queued_stage> stages;
+        span<const queued_vertex_binding> vertex_input_bindings;
+        span<const image_info> images;
+        span<const storage_buffer_info> storage_buffers;
+        span<const queued_stage> fallback_stages;
+    };
+
+    struct queued_dispatch : dispatch_info {
+        queued_stage stage;
+        span<const storage_buffer_info> storage_buffers;
+    };
+
+    struct queued_pass : pass_info {
+        span<const attachment_info> color_attachments;
+    };
+
+    // copies a call and everything it points to into one record, without a
+    // target it only measures the size of the record
+    struct record_writer {
+        std::byte* target = nullptr;
+        size_t size = 0;
+
+        template<class T>
+        span<T> allocate(size_t count) {
+            size = aligned(size, alignof(T));
+            span<T> result;
+            if (target && count > 0) {
+                result = { reinterpret_cast<T*>(target + size), count };
+                ranges::uninitialized_value_construct(result);
+            }
+            size += count * sizeof(T);
+            return result;
+        }
+
+        template<class T>
+        span<const T> copy(const T* source, size_t count) {
+            auto result = allocate<T>(count);
+            if (!result.empty())
+                std::copy_n(source, count, result.begin());
+            return result;
+        }
+
+        const void* copy_bytes(const void* source, size_t count) {
+            return copy(static_cast<const std::byte*>(source), count).data();
+        }
+
+        const char* copy_string(const char* source) {
+            if (!source)
+                return nullptr;
+            return copy(source, strlen(source) + 1).data();
+        }
+
+        string_view copy_view(string_view source) {
+            auto result = copy(source.data(), source.size());
+            return result.empty() ? 
+                string_view() : string_view(result.data(), result.size());
+        }
+    };
+
+    queued_stage copy_stage(record_writer& w, const stage_info& stage) {
+        queued_stage result{};
+        result.code_file_name = w.copy_string(stage.code_file_name);
+        result.info = stage.info;
+        result.info.pName = w.copy_string(stage.info.pName);
+        result.specialization_entries = w.copy(
+            data(stage.specialization_entries), 
+            size(stage.specialization_entries)
+        );
+        result.specialization_data = w.copy_bytes(
+            stage.specialization_data, stage.specialization_data_size
+        );
+        result.specialization_data_size = stage.specialization_data_size;
+        return result;
+    }
+
+    span<const queued_stage> copy_stages(
+        record_writer& w, std::initializer_list<stage_info> stages
+    ) {
+        auto result = w.allocate<queued_stage>(stages.size());
+        size_t i = 0;
+        for (const auto& stage : stages) {
+            auto copy = copy_stage(w, stage);
+            if (!result.empty())
+                result[i] = copy;
+            i++;
+        }
+        return result;
+    }
+
+    span<const storage_buffer_info> copy_storage_buffers(
+        record_writer& w, std::initializer_list<storage_buffer_info> buffers
+    ) {
+        auto result = w.allocate<storage_buffer_info>(buffers.size());
+        size_t i = 0;
+        for (const auto& buffer : buffers) {
+            if (!result.empty()) {
+                result[i] = buffer;
+                result[i].name = w.copy_view(buffer.name);
+            } else {
+                w.copy_view(buffer.name);
+            }
+            i++;
+        }
+        return result;
+    }
+
+    const queued_draw* copy_draw(record_writer& w, const draw_info& info) {
+        auto result = w.allocate<queued_draw>(1);
+        queued_draw copy{};
+        static_cast<draw_info&>(copy) = info;
+        copy.draw_info::stages = {};
+        copy.draw_info::vertex_input_bindings = {};
+        copy.draw_info::images = {};
+        copy.draw_info::storage_buffers = {};
+        copy.draw_info::fallback_stages = {};
+
+        copy.stages = copy_stages(w, info.stages);
+
+        auto bindings = w.allocate<queued_vertex_binding>(
+            info.vertex_input_bindings.size()
+        );
+        size_t i = 0;
+        for (const auto& binding : info.vertex_input_bindings) {
+            queued_vertex_binding binding_copy{};
+            static_cast<vertex_binding_info&>(binding_copy) = binding;
+            binding_copy.vertex_binding_info::attributes = {};
+            binding_copy.buffer_source_pointer = w.copy_bytes(
+                binding.buffer_source_pointer, binding.buffer_source_size
+            );
+            binding_copy.attributes = w.copy(
+                data(binding.attributes), size(binding.attributes)
+            );
+            if (!bindings.empty())
+                bindings[i] = binding_copy;
+            i++;
+        }
+        copy.vertex_input_bindings = bindings;
+
+        auto images = w.allocate<image_info>(info.images.size());
+        i = 0;
+        for (const auto& image : info.images) {
+            image_info image_copy = image;
+            image_copy.file_name = w.copy_view(image.file_name);
+            image_copy.render_target = w.copy_view(image.render_target);
+            if (!images.empty())
+                images[i] = image_copy;
+            i++;
+        }
+        copy.images = images;
+        copy.storage_buffers = copy_storage_buffers(w, info.storage_buffers);
+
+        copy.uniform_source_pointer = w.copy_bytes(
+            info.uniform_source_pointer, info.uniform_source_size
+        );
+        copy.fallback_stages = copy_stages(w, info.fallback_stages);
+
+        if (result.empty())
+            return nullptr;
+        result[0] = copy;
+        return result.data();
+    }
+
+    const queued_dispatch* copy_dispatch(
+        record_writer& w, const dispatch_info& info
+    ) {
+        auto result = w.allocate<queued_dispatch>(1);
+        queued_dispatch copy{};
+        static_cast<dispatch_info&>(copy) = info;
+        copy.dispatch_info::stage = {};
+        copy.dispatch_info::storage_buffers = {};
+
+        copy.stage = copy_stage(w, info.stage);
+        copy.storage_buffers = copy_storage_buffers(w, info.storage_buffers);
+        copy.uniform_source_pointer = w.copy_bytes(
+            info.uniform_source_pointer, info.uniform_source_size
+        );
+
+        if (result.empty())
+            return nullptr;
+        result[0] = copy;
+        return result.data();
+    }
+
+    const queued_pass* copy_pass(record_writer& w, const pass_info& info) {
+        auto result = w.allocate<queued_pass>(1);
+        queued_pass copy{};
+        static_cast<pass_info&>(copy) = info;
+        copy.pass_info::color_attachments = {};
+
+        auto attachments = w.allocate<attachment_info>(
+            info.color_attachments.size()
+        );
+        size_t i = 0;
+        for (const auto& attachment : info.color_attachments) {
+            attachment_info attachment_copy = attachment;
+            attachment_copy.name = w.copy_view(attachment.name);
+            if (!attachments.empty())
+                attachments[i] = attachment_copy;
+            i++;
+        }
+        copy.color_attachments = attachments;
+
+        if (result.empty())
+            return nullptr;
+        result[0] = copy;
+        return result.data();
+    }
+
+    const void* no_arguments(record_writer&) {
+        return nullptr;
+    }
+
+    // only draws and dispatches can be dropped, the frame structure is kept
+    template<class Copy>
+    bool enqueue(
+        renderer_data& r, command_type type, bool droppable, Copy copy
+    ) {
+        auto write = [&](record_writer& w) {
+            auto command = w.allocate<queued_command>(1);
+            const void* object = copy(w);
+            if (!command.empty())
+                command[0] = { type, object };
+        };
+        record_writer measure;
+        write(measure);
+
+        std::byte* record;
+        if (r.queue_full == queue_policy::grow)
+            record = r.queue->push_grown(measure.size);
+        else if (r.queue_full == queue_policy::drop && droppable)
+            record = r.queue->try_push(measure.size);
+        else
+            record = r.queue->push(measure.size);
+        if (!record)
+            return false;
+
+        record_writer writer{ .target = record };
+        write(writer);
+        r.queue->commit();
+        return true;
+    }
+
+    void rethrow_render_error(renderer_data& r) {
+        if (!r.render_failed.load(memory_order_acquire))
+            return;
+        exception_ptr error;
+        {
+            lock_guard lock(r.render_error_mutex);
+            error = std::exchange(r.render_error, nullptr);
+            r.render_failed.store(false, memory_order_release);
+        }
+        if (error)
+            rethrow_exception(error);
+    }
+
+    void run_render_thread(renderer_data& r) {
+        while (true) {
+            auto& command = *reinterpret_cast<const queued_command*>(
+                r.queue->wait_front()
+            );
+            try {
+                switch (command.type) {
+                case command_type::wait_frame:
+                    wait_frame(r);
+                    break;
+                case command_type::draw:
+                    draw(r, *static_cast<const queued_draw*>(command.object));
+                    break;
+                case command_type::dispatch:
+                    dispatch(
+                        r, *static_cast<const queued_dispatch*>(command.object)
+                    );
+                    break;
+                case command_type::begin_pass:
+                    begin_pass(
+                        r, *static_cast<const queued_pass*>(command.object)
+                    );
+                    break;
+                case command_type::end_pass:
+                    end_pass(r);
+                    break;
+                case command_type::submit:
+                    submit(r);
+                    break;
+                case command_type::stop:
+                    r.queue->pop();
+                    return;
+                }
+            } catch (...) {
+                lock_guard lock(r.render_error_mutex);
+                if (!r.render_error)
+                    r.render_error = current_exception();
+                r.render_failed.store(true, memory_order_release);
+            }
+            r.queue->pop();
+        }
+    }
+
+    void stop_render_thread(renderer_data& r) {
+        enqueue(r, command_type::stop, false, no_arguments);
+        r.render_thread.join();
+    }
+
+    void wait_frame(renderer* renderer) {
+        renderer_data& r = *get(renderer).d;
+        if (r.queue) {
+            rethrow_render_error(r);
+            enqueue(r, command_type::wait_frame, false, no_arguments);
+            return;
+        }
+        wait_frame(r);
+    }
+
+    bool draw(const draw_info& info) {
+        renderer_data& r = *get(info.renderer).d;
+        if (r.queue) {
+            return enqueue(r, command_type::draw, true, [&](auto& w) { 
+                return copy_draw(w, info); 
+            });
+        }
+        return draw(r, info);
+    }
+
+    bool dispatch(const dispatch_info& info) {
+        renderer_data& r = *get(info.renderer).d;
+        if (r.queue) {
+            return enqueue(r, command_type::dispatch, true, [&](auto& w) { 
+                return copy_dispatch(w, info); 
+            });
+        }
+        return dispatch(r, info);
+    }
+
+    void begin_pass(const pass_info& info) {
+        renderer_data& r = *get(info.renderer).d;
+        if (r.queue) {
+            enqueue(r, command_type::begin_pass, false, [&](auto& w) { 
+                return copy_pass(w, info); 
+            });
+            return;
+        }
+        begin_pass(r, info);
+    }
+
+    void end_pass(renderer* renderer) {
+        renderer_data& r = *get(renderer).d;
+        if (r.queue) {
+            enqueue(r, command_type::end_pass, false, no_arguments);
+            return;
+        }
+        end_pass(r);
+    }
+
+    void submit(renderer* renderer) {
+        renderer_data& r = *get(renderer).d;
+        if (r.queue) {
+            rethrow_render_error(r);
+            enqueue(r, command_type::submit, false, no_arguments);
+            return;
+        }
+        submit(r);
+    }
 }
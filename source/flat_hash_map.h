@@ -0,0 +1,181 @@
+#pragma once
+
+#include "hash.h"
+#include "serialize.h"
+
+#include <cstdint>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace imv {
+    // Compares the words pushed by visit with a stored key.
+    struct key_comparer {
+        std::span<const uint64_t> key;
+        size_t position = 0;
+        bool equal = true;
+
+        void push_back(uint64_t word) {
+            equal = equal && position < key.size() && key[position] == word;
+            position++;
+        }
+
+        bool result() const { 
+            return equal && position == key.size(); 
+        }
+    };
+
+    // Open addressing hash map keyed by objects that can be visited. Lookups
+    // stream the objects into a 128 bit hash and only serialize them again to
+    // verify the full key when the hash matches. Values have stable addresses.
+    template<class Value>
+    class flat_hash_map {
+    public:
+        // returns the value for the key formed by the objects and whether it
+        // was inserted
+        template<class... Objects>
+        std::pair<Value*, bool> try_emplace(const Objects&... objects) {
+            auto hash = key_hash(objects...);
+            if (auto s = find_slot(hash, objects...))
+                return {&entries[s->index].value, false};
+
+            if ((used + 1) * 4 > slots.size() * 3)
+                grow();
+
+            // erased slots are reused, probing already passed the key
+            size_t mask = slots.size() - 1;
+            size_t i = hash.low & mask;
+            while (slots[i].index != empty && slots[i].index != erased)
+                i = (i + 1) & mask;
+            if (slots[i].index == empty)
+                used++;
+
+            uint32_t index;
+            if (free.empty()) {
+                index = uint32_t(entries.size());
+                entries.emplace_back();
+            } else {
+                index = free.back();
+                free.pop_back();
+            }
+            auto& e = entries[index];
+            (visit(e.key, objects), ...);
+            slots[i] = {hash, index};
+            return {&e.value, true};
+        }
+
+        // returns the value for the key formed by the objects, or null
+        template<class... Objects>
+        Value* find(const Objects&... objects) {
+            auto s = find_slot(key_hash(objects...), objects...);
+            return s ? &entries[s->index].value : nullptr;
+        }
+
+        // destroys the value for the key formed by the objects, returns 
+        // whether there was one
+        template<class... Objects>
+        bool erase(const Objects&... objects) {
+            auto s = find_slot(key_hash(objects...), objects...);
+            if (!s)
+                return false;
+            auto& e = entries[s->index];
+            e.key.clear();
+            std::destroy_at(&e.value);
+            std::construct_at(&e.value);
+            free.push_back(s->index);
+            s->index = erased;
+            return true;
+        }
+
+        // destroys the values for which pred(key, value) returns true, 
+        // where key holds the words visited for the objects
+        template<class Pred>
+        void erase_if(Pred pred) {
+            for (auto& s : slots) {
+                if (s.index == empty || s.index == erased)
+                    continue;
+                auto& e = entries[s.index];
+                if (!pred(std::span<const uint64_t>(e.key), e.value))
+                    continue;
+                e.key.clear();
+                std::destroy_at(&e.value);
+                std::construct_at(&e.value);
+                free.push_back(s.index);
+                s.index = erased;
+            }
+        }
+
+        size_t size() const { return entries.size() - free.size(); }
+
+    private:
+        static constexpr uint32_t empty = ~0u;
+        // keeps probing past the slot of an erased entry
+        static constexpr uint32_t erased = ~0u - 1;
+
+        struct slot {
+            hash128 hash;
+            uint32_t index = empty;
+        };
+
+        struct entry {
+            std::vector<uint64_t> key;
+            Value value{};
+        };
+
+        template<class... Objects>
+        static hash128 key_hash(const Objects&... objects) {
+            hasher h;
+            (visit(h, objects), ...);
+            return h.finish();
+        }
+
+        template<class... Objects>
+        slot* find_slot(hash128 hash, const Objects&... objects) {
+            if (slots.empty())
+                return nullptr;
+            size_t mask = slots.size() - 1;
+            for (size_t i = hash.low & mask;; i = (i + 1) & mask) {
+                auto& s = slots[i];
+                if (s.index == empty)
+                    return nullptr;
+                if (s.index != erased && s.hash == hash) {
+                    key_comparer comparer{entries[s.index].key};
+                    (visit(comparer, objects), ...);
+                    if (comparer.result())
+                        return &s;
+                }
+            }
+        }
+
+        // rehashes without erased slots, doubling unless erasing made room
+        void grow() {
+            size_t count = std::max<size_t>(slots.size(), 16);
+            if ((size() + 1) * 2 > count)
+                count *= 2;
+            std::vector<slot> old(count);
+            std::swap(old, slots);
+            size_t mask = slots.size() - 1;
+            used = 0;
+            for (auto& s : old) {
+                if (s.index == empty || s.index == erased)
+                    continue;
+                size_t i = s.hash.low & mask;
+                while (slots[i].index != empty)
+                    i = (i + 1) & mask;
+                slots[i] = s;
+                used++;
+            }
+        }
+
+        std::vector<slot> slots;
+        // slots that are not empty, including erased ones
+        size_t used = 0;
+        // deque doesn't move elements when growing
+        std::deque<entry> entries;
+        // indices of erased entries, reused by the next insertions
+        std::vector<uint32_t> free;
+    };
+}
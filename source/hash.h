@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+namespace imv {
+    struct hash128 {
+        uint64_t low, high;
+
+        bool operator==(const hash128&) const = default;
+    };
+
+    // Streaming 128 bit hash over 64 bit words, usable as a visitor for the 
+    // functions in serialize.h. Each half is an independent xxh64-style lane
+    // with its own seed and constants.
+    struct hasher {
+        static constexpr uint64_t prime_1 = 0x9e3779b185ebca87ull;
+        static constexpr uint64_t prime_2 = 0xc2b2ae3d27d4eb4full;
+        static constexpr uint64_t prime_3 = 0x165667b19e3779f9ull;
+        static constexpr uint64_t prime_4 = 0x85ebca77c2b2ae63ull;
+
+        uint64_t low = 0x27d4eb2f165667c5ull, high = 0x61c8864e7a143579ull;
+        uint64_t length = 0;
+
+        static uint64_t rotate_left(uint64_t value, int bits) {
+            return (value << bits) | (value >> (64 - bits));
+        }
+
+        static uint64_t avalanche(uint64_t value) {
+            value ^= value >> 33;
+            value *= prime_2;
+            value ^= value >> 29;
+            value *= prime_3;
+            value ^= value >> 32;
+            return value;
+        }
+
+        void push_back(uint64_t word) {
+            low = rotate_left(low + word * prime_2, 31) * prime_1;
+            high = rotate_left(high ^ (word * prime_4), 27) * prime_3 + prime_1;
+            length++;
+        }
+
+        hash128 finish() const {
+            return {
+                avalanche(low ^ length), 
+                avalanche(high + length * prime_4),
+            };
+        }
+    };
+}
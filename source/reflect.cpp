@@ -0,0 +1,340 @@
+#include "reflect.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace imv {
+    namespace spirv {
+        const uint32_t magic = 0x07230203;
+
+        enum op : uint16_t {
+            op_entry_point = 15,
+            op_type_bool = 20,
+            op_type_int = 21,
+            op_type_float = 22,
+            op_type_vector = 23,
+            op_type_matrix = 24,
+            op_type_image = 25,
+            op_type_sampler = 26,
+            op_type_sampled_image = 27,
+            op_type_array = 28,
+            op_type_runtime_array = 29,
+            op_type_struct = 30,
+            op_type_pointer = 32,
+            op_constant = 43,
+            op_spec_constant_true = 48,
+            op_spec_constant_false = 49,
+            op_spec_constant = 50,
+            op_variable = 59,
+            op_decorate = 71,
+            op_member_decorate = 72,
+            op_type_acceleration_structure = 5341,
+        };
+
+        enum decoration : uint32_t {
+            decoration_spec_id = 1,
+            decoration_block = 2,
+            decoration_buffer_block = 3,
+            decoration_array_stride = 6,
+            decoration_matrix_stride = 7,
+            decoration_binding = 33,
+            decoration_descriptor_set = 34,
+            decoration_offset = 35,
+        };
+
+        enum storage_class : uint32_t {
+            storage_uniform_constant = 0,
+            storage_uniform = 2,
+            storage_push_constant = 9,
+            storage_storage_buffer = 12,
+        };
+
+        enum dim : uint32_t {
+            dim_buffer = 5,
+            dim_subpass_data = 6,
+        };
+    }
+
+    namespace {
+        struct type {
+            uint16_t op = 0;
+            // operands of the type instruction, without the result id
+            std::span<const uint32_t> operands;
+            // decorations of the type
+            uint32_t array_stride = 0;
+            bool block = false, buffer_block = false;
+            // decorations of struct members
+            std::vector<uint32_t> member_offsets, member_matrix_strides;
+        };
+
+        struct variable {
+            uint32_t pointer_type, storage_class;
+            uint32_t set = 0, binding = 0;
+        };
+
+        struct module {
+            std::unordered_map<uint32_t, type> types;
+            // specialization constants hold their default value
+            std::unordered_map<uint32_t, uint32_t> constants;
+            std::unordered_map<uint32_t, uint32_t> spec_ids;
+            std::unordered_map<uint32_t, variable> variables;
+            std::unordered_map<uint32_t, uint32_t> sets, bindings;
+
+            uint32_t constant(uint32_t id) const {
+                auto c = constants.find(id);
+                if (c == constants.end()) {
+                    throw std::runtime_error(
+                        "array lengths computed from specialization "
+                        "constants are not supported"
+                    );
+                }
+                return c->second;
+            }
+
+            uint32_t size(uint32_t id, uint32_t matrix_stride = 0) const {
+                auto& t = types.at(id);
+                switch (t.op) {
+                case spirv::op_type_bool:
+                    return 4;
+                case spirv::op_type_int:
+                case spirv::op_type_float:
+                    return t.operands[0] / 8;
+                case spirv::op_type_vector:
+                    return t.operands[1] * size(t.operands[0]);
+                case spirv::op_type_matrix:
+                    return t.operands[1] * (
+                        matrix_stride ? matrix_stride : size(t.operands[0])
+                    );
+                case spirv::op_type_array: {
+                    uint32_t length = constant(t.operands[1]);
+                    uint32_t stride = t.array_stride ? 
+                        t.array_stride : size(t.operands[0], matrix_stride);
+                    return length * stride;
+                }
+                case spirv::op_type_runtime_array:
+                    // only the fixed part of a buffer counts
+                    return 0;
+                case spirv::op_type_struct: {
+                    uint32_t result = 0;
+                    for (auto i = 0u; i < t.operands.size(); i++) {
+                        uint32_t offset = i < t.member_offsets.size() ?
+                            t.member_offsets[i] : result;
+                        uint32_t stride = i < t.member_matrix_strides.size() ?
+                            t.member_matrix_strides[i] : 0;
+                        result = std::max(
+                            result, offset + size(t.operands[i], stride)
+                        );
+                    }
+                    return result;
+                }
+                default:
+                    return 0;
+                }
+            }
+        };
+
+        void resize_for(std::vector<uint32_t>& vector, uint32_t index) {
+            if (vector.size() <= index)
+                vector.resize(index + 1);
+        }
+
+        VkShaderStageFlags stage_of(uint32_t execution_model) {
+            switch (execution_model) {
+            case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+            case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+            case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+            case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+            case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+            case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+            default: return 0;
+            }
+        }
+    }
+
+    shader_reflection reflect(std::span<const uint32_t> code) {
+        if (code.size() < 5 || code[0] != spirv::magic)
+            throw std::runtime_error("invalid SPIR-V");
+
+        shader_reflection result;
+        module m;
+
+        for (size_t i = 5; i < code.size();) {
+            uint16_t op = code[i] & 0xffff;
+            uint16_t word_count = code[i] >> 16;
+            if (word_count == 0 || i + word_count > code.size())
+                throw std::runtime_error("invalid SPIR-V");
+            auto operands = code.subspan(i + 1, word_count - 1);
+            i += word_count;
+
+            switch (op) {
+            case spirv::op_entry_point:
+                result.stage |= stage_of(operands[0]);
+                break;
+            case spirv::op_type_bool:
+            case spirv::op_type_int:
+            case spirv::op_type_float:
+            case spirv::op_type_vector:
+            case spirv::op_type_matrix:
+            case spirv::op_type_image:
+            case spirv::op_type_sampler:
+            case spirv::op_type_sampled_image:
+            case spirv::op_type_array:
+            case spirv::op_type_runtime_array:
+            case spirv::op_type_struct:
+            case spirv::op_type_pointer:
+            case spirv::op_type_acceleration_structure: {
+                auto& t = m.types[operands[0]];
+                t.op = op;
+                t.operands = operands.subspan(1);
+                break;
+            }
+            case spirv::op_constant:
+            case spirv::op_spec_constant:
+                // only 32 bit constants are needed for array lengths
+                m.constants[operands[1]] = operands[2];
+                break;
+            case spirv::op_spec_constant_true:
+                m.constants[operands[1]] = 1;
+                break;
+            case spirv::op_spec_constant_false:
+                m.constants[operands[1]] = 0;
+                break;
+            case spirv::op_variable:
+                m.variables[operands[1]] = {
+                    .pointer_type = operands[0], 
+                    .storage_class = operands[2],
+                };
+                break;
+            case spirv::op_decorate:
+                switch (operands[1]) {
+                case spirv::decoration_spec_id:
+                    m.spec_ids[operands[0]] = operands[2];
+                    break;
+                case spirv::decoration_binding:
+                    m.bindings[operands[0]] = operands[2];
+                    break;
+                case spirv::decoration_descriptor_set:
+                    m.sets[operands[0]] = operands[2];
+                    break;
+                case spirv::decoration_block:
+                    m.types[operands[0]].block = true;
+                    break;
+                case spirv::decoration_buffer_block:
+                    m.types[operands[0]].buffer_block = true;
+                    break;
+                case spirv::decoration_array_stride:
+                    m.types[operands[0]].array_stride = operands[2];
+                    break;
+                }
+                break;
+            case spirv::op_member_decorate: {
+                auto& t = m.types[operands[0]];
+                if (operands[2] == spirv::decoration_offset) {
+                    resize_for(t.member_offsets, operands[1]);
+                    t.member_offsets[operands[1]] = operands[3];
+                } else if (operands[2] == spirv::decoration_matrix_stride) {
+                    resize_for(t.member_matrix_strides, operands[1]);
+                    t.member_matrix_strides[operands[1]] = operands[3];
+                }
+                break;
+            }
+            }
+        }
+
+        for (auto& [id, v] : m.variables) {
+            auto& pointer = m.types.at(v.pointer_type);
+            uint32_t type_id = pointer.operands[1];
+
+            if (v.storage_class == spirv::storage_push_constant) {
+                result.push_constant_size = std::max(
+                    result.push_constant_size, m.size(type_id)
+                );
+                continue;
+            }
+
+            if (
+                v.storage_class != spirv::storage_uniform_constant &&
+                v.storage_class != spirv::storage_uniform &&
+                v.storage_class != spirv::storage_storage_buffer
+            )
+                continue;
+
+            shader_binding binding{
+                .set = m.sets.contains(id) ? m.sets[id] : 0,
+                .binding = m.bindings.contains(id) ? m.bindings[id] : 0,
+                .count = 1,
+                .stages = result.stage,
+                .size = 0,
+            };
+
+            // arrays of descriptors
+            const type* t = &m.types.at(type_id);
+            while (
+                t->op == spirv::op_type_array || 
+                t->op == spirv::op_type_runtime_array
+            ) {
+                if (t->op == spirv::op_type_array) {
+                    auto length_id = t->operands[1];
+                    auto spec_id = m.spec_ids.find(length_id);
+                    if (spec_id != m.spec_ids.end()) {
+                        if (binding.count_constant_id != ~0u) {
+                            throw std::runtime_error(
+                                "descriptor arrays with several specialized "
+                                "lengths are not supported"
+                            );
+                        }
+                        binding.count_constant_id = spec_id->second;
+                    } else {
+                        binding.count_factor *= m.constant(length_id);
+                    }
+                    binding.count *= m.constant(length_id);
+                }
+                type_id = t->operands[0];
+                t = &m.types.at(type_id);
+            }
+
+            switch (t->op) {
+            case spirv::op_type_sampled_image:
+                binding.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                break;
+            case spirv::op_type_sampler:
+                binding.type = VK_DESCRIPTOR_TYPE_SAMPLER;
+                break;
+            case spirv::op_type_image: {
+                uint32_t dim = t->operands[1];
+                bool storage = t->operands[5] == 2;
+                if (dim == spirv::dim_subpass_data)
+                    binding.type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+                else if (dim == spirv::dim_buffer)
+                    binding.type = storage ? 
+                        VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER :
+                        VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+                else
+                    binding.type = storage ?
+                        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE :
+                        VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+                break;
+            }
+            case spirv::op_type_struct:
+                binding.type = 
+                    v.storage_class == spirv::storage_storage_buffer || 
+                    t->buffer_block ?
+                    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER :
+                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+                binding.size = m.size(type_id);
+                break;
+            default:
+                continue;
+            }
+
+            result.bindings.push_back(binding);
+        }
+
+        std::ranges::sort(result.bindings, {}, [](const shader_binding& b) {
+            return std::pair(b.set, b.binding);
+        });
+
+        return result;
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+namespace imv {
+    struct shader_binding {
+        uint32_t set, binding;
+        VkDescriptorType type;
+        uint32_t count;
+        VkShaderStageFlags stages;
+        // size of the block for uniform and storage buffers, arrays in it
+        // sized by specialization constants count with their default value
+        uint32_t size;
+        // if a specialization constant sizes the descriptor array, count is
+        // count_factor times its value, the default value until specialized
+        uint32_t count_constant_id = ~0u;
+        uint32_t count_factor = 1;
+    };
+
+    struct shader_reflection {
+        VkShaderStageFlags stage = 0;
+        std::vector<shader_binding> bindings;
+        // size of the push constant block, 0 if there is none
+        uint32_t push_constant_size = 0;
+    };
+
+    // Extracts the resource interface of a SPIR-V module. Throws 
+    // std::runtime_error if the code is not valid SPIR-V.
+    shader_reflection reflect(std::span<const uint32_t> code);
+}
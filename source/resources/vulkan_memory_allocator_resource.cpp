@@ -2,5 +2,3 @@
 
 #define VMA_IMPLEMENTATION
 #include <vk_mem_alloc.h>
-
-VmaAllocator imv::current_allocator = VK_NULL_HANDLE;
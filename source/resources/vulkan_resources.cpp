@@ -1,6 +0,0 @@
-#include <immediate_mode_vulkan/resources/vulkan_resources.h>
-
-namespace imv {
-    VkInstance current_instance;
-    VkDevice current_device;
-}
@@ -1,6 +1,10 @@
 #include "vulkan/vulkan_core.h"
+#include <algorithm>
+#include <bit>
 #include <cstdint>
+#include <cstring>
 #include <span>
+#include <string_view>
 #include <type_traits>
 #include <vector>
 #include <concepts>
@@ -11,18 +15,31 @@ namespace imv {
     template<class T>
     struct tag_t {};
     
+    // the buffer can be any container of uint64_t with push_back
     template<std::integral T>
-    void visit(std::vector<uint64_t>& buffer, auto value, tag_t<T>) {
+    void visit(auto& buffer, auto value, tag_t<T>) {
         buffer.push_back(uint64_t(value));
     }
 
     template<class T>
     std::enable_if_t<std::is_enum_v<T>> visit(
-        std::vector<uint64_t>& buffer, auto value, tag_t<T>
+        auto& buffer, auto value, tag_t<T>
     ) {
         buffer.push_back(uint64_t(value));
     }
 
+    template<std::floating_point T>
+    void visit(auto& buffer, auto value, tag_t<T>) {
+        buffer.push_back(std::bit_cast<uint64_t>(double(value)));
+    }
+
+    // non-dispatchable handles are pointers on 64 bit platforms and 
+    // integers on 32 bit platforms, both are keyed by value
+    template<class T>
+    void visit(auto& buffer, auto value, tag_t<T*>) {
+        buffer.push_back(uint64_t(uintptr_t(value)));
+    }
+
     void visit(auto&& visitor, auto&& object) {
         visit(visitor, object, tag_t<std::remove_cvref_t<decltype(object)>>());
     }
@@ -39,6 +56,31 @@ namespace imv {
     void visit_array(auto&& visitor, T* pointer, size_t size) {
         visit(visitor, std::span<T>(pointer, size));
     }
+
+    template<class T>
+    void visit_optional(auto&& visitor, const T* pointer) {
+        visit(visitor, pointer != nullptr);
+        if (pointer)
+            visit(visitor, *pointer);
+    }
+
+    void visit_string(auto&& visitor, const char* string) {
+        std::string_view view = string ? string : "";
+        visit(visitor, view.size());
+        for (auto character : view)
+            visit(visitor, character);
+    }
+
+    // packs eight bytes per word
+    void visit_bytes(auto&& visitor, const void* data, size_t size) {
+        visit(visitor, size);
+        auto bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i += 8) {
+            uint64_t word = 0;
+            std::memcpy(&word, bytes + i, std::min<size_t>(8, size - i));
+            visit(visitor, word);
+        }
+    }
     
 
     void visit(auto&& visitor, auto&& object, tag_t<VkDescriptorPoolSize>) {
@@ -95,4 +137,338 @@ namespace imv {
             visitor, object.pPushConstantRanges, object.pushConstantRangeCount
         );
     }
+
+    void visit(
+        auto&& visitor, auto&& object, tag_t<VkSpecializationMapEntry>
+    ) {
+        visit(visitor, object.constantID);
+        visit(visitor, object.offset);
+        visit(visitor, object.size);
+    }
+
+    void visit(auto&& visitor, auto&& object, tag_t<VkSpecializationInfo>) {
+        visit_array(visitor, object.pMapEntries, object.mapEntryCount);
+        visit_bytes(visitor, object.pData, object.dataSize);
+    }
+
+    void visit(
+        auto&& visitor, auto&& object, tag_t<VkPipelineShaderStageCreateInfo>
+    ) {
+        visit(visitor, object.sType);
+        //visit(visitor, object.pNext);
+        visit(visitor, object.flags);
+        visit(visitor, object.stage);
+        // handles of destroyed modules are reused, users of the stages add 
+        // the hashes of the modules' code to their keys instead
+        //visit(visitor, object.module);
+        visit_string(visitor, object.pName);
+        visit_optional(visitor, object.pSpecializationInfo);
+    }
+
+    void visit(
+        auto&& visitor, auto&& object, tag_t<VkVertexInputBindingDescription>
+    ) {
+        visit(visitor, object.binding);
+        visit(visitor, object.stride);
+        visit(visitor, object.inputRate);
+    }
+
+    void visit(
+        auto&& visitor, auto&& object, 
+        tag_t<VkVertexInputAttributeDescription>
+    ) {
+        visit(visitor, object.location);
+        visit(visitor, object.binding);
+        visit(visitor, object.format);
+        visit(visitor, object.offset);
+    }
+
+    void visit(
+        auto&& visitor, auto&& object, 
+        tag_t<VkPipelineVertexInputStateCreateInfo>
+    ) {
+        visit(visitor, object.sType);
+        //visit(visitor, object.pNext);
+        visit(visitor, object.flags);
+        visit_array(
+            visitor, object.pVertexBindingDescriptions, 
+            object.vertexBindingDescriptionCount
+        );
+        visit_array(
+            visitor, object.pVertexAttributeDescriptions, 
+            object.vertexAttributeDescriptionCount
+        );
+    }
+
+    void visit(
+        auto&& visitor, auto&& object, 
+        tag_t<VkPipelineInputAssemblyStateCreateInfo>
+    ) {
+        visit(visitor, object.sType);
+        //visit(visitor, object.pNext);
+        visit(visitor, object.flags);
+        visit(visitor, object.topology);
+        visit(visitor, object.primitiveRestartEnable);
+    }
+
+    void visit(
+        auto&& visitor, auto&& object, 
+        tag_t<VkPipelineViewportStateCreateInfo>
+    ) {
+        visit(visitor, object.sType);
+        //visit(visitor, object.pNext);
+        visit(visitor, object.flags);
+        // viewports and scissors are dynamic
+        visit(visitor, object.viewportCount);
+        visit(visitor, object.scissorCount);
+    }
+
+    void visit(
+        auto&& visitor, auto&& object, 
+        tag_t<VkPipelineRasterizationStateCreateInfo>
+    ) {
+        visit(visitor, object.sType);
+        //visit(visitor, object.pNext);
+        visit(visitor, object.flags);
+        visit(visitor, object.depthClampEnable);
+        visit(visitor, object.rasterizerDiscardEnable);
+        visit(visitor, object.polygonMode);
+        visit(visitor, object.cullMode);
+        visit(visitor, object.frontFace);
+        visit(visitor, object.depthBiasEnable);
+        visit(visitor, object.depthBiasConstantFactor);
+        visit(visitor, object.depthBiasClamp);
+        visit(visitor, object.depthBiasSlopeFactor);
+        visit(visitor, object.lineWidth);
+    }
+
+    void visit(
+        auto&& visitor, auto&& object, 
+        tag_t<VkPipelineMultisampleStateCreateInfo>
+    ) {
+        visit(visitor, object.sType);
+        //visit(visitor, object.pNext);
+        visit(visitor, object.flags);
+        visit(visitor, object.rasterizationSamples);
+        visit(visitor, object.sampleShadingEnable);
+        visit(visitor, object.minSampleShading);
+        // TODO: object.pSampleMask has rasterizationSamples bits
+        visit(visitor, object.alphaToCoverageEnable);
+        visit(visitor, object.alphaToOneEnable);
+    }
+
+    void visit(
+        auto&& visitor, auto&& object, 
+        tag_t<VkPipelineColorBlendAttachmentState>
+    ) {
+        visit(visitor, object.blendEnable);
+        visit(visitor, object.srcColorBlendFactor);
+        visit(visitor, object.dstColorBlendFactor);
+        visit(visitor, object.colorBlendOp);
+        visit(visitor, object.srcAlphaBlendFactor);
+        visit(visitor, object.dstAlphaBlendFactor);
+        visit(visitor, object.alphaBlendOp);
+        visit(visitor, object.colorWriteMask);
+    }
+
+    void visit(
+        auto&& visitor, auto&& object, 
+        tag_t<VkPipelineColorBlendStateCreateInfo>
+    ) {
+        visit(visitor, object.sType);
+        //visit(visitor, object.pNext);
+        visit(visitor, object.flags);
+        visit(visitor, object.logicOpEnable);
+        visit(visitor, object.logicOp);
+        visit_array(visitor, object.pAttachments, object.attachmentCount);
+        for (auto constant : object.blendConstants)
+            visit(visitor, constant);
+    }
+
+    void visit(
+        auto&& visitor, auto&& object, 
+        tag_t<VkPipelineDynamicStateCreateInfo>
+    ) {
+        visit(visitor, object.sType);
+        //visit(visitor, object.pNext);
+        visit(visitor, object.flags);
+        visit_array(
+            visitor, object.pDynamicStates, object.dynamicStateCount
+        );
+    }
+
+    void visit(auto&& visitor, auto&& object, tag_t<VkStencilOpState>) {
+        visit(visitor, object.failOp);
+        visit(visitor, object.passOp);
+        visit(visitor, object.depthFailOp);
+        visit(visitor, object.compareOp);
+        visit(visitor, object.compareMask);
+        visit(visitor, object.writeMask);
+        visit(visitor, object.reference);
+    }
+
+    void visit(
+        auto&& visitor, auto&& object, 
+        tag_t<VkPipelineDepthStencilStateCreateInfo>
+    ) {
+        visit(visitor, object.sType);
+        //visit(visitor, object.pNext);
+        visit(visitor, object.flags);
+        visit(visitor, object.depthTestEnable);
+        visit(visitor, object.depthWriteEnable);
+        visit(visitor, object.depthCompareOp);
+        visit(visitor, object.depthBoundsTestEnable);
+        visit(visitor, object.stencilTestEnable);
+        visit(visitor, object.front);
+        visit(visitor, object.back);
+        visit(visitor, object.minDepthBounds);
+        visit(visitor, object.maxDepthBounds);
+    }
+
+    // the only structure chained to pipelines that is part of their key
+    inline const VkPipelineRenderingCreateInfoKHR* rendering_create_info(
+        const void* next
+    ) {
+        auto structure = static_cast<const VkBaseInStructure*>(next);
+        for (; structure; structure = structure->pNext) {
+            if (
+                structure->sType == 
+                VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR
+            ) {
+                return reinterpret_cast<
+                    const VkPipelineRenderingCreateInfoKHR*
+                >(structure);
+            }
+        }
+        return nullptr;
+    }
+
+    void visit(
+        auto&& visitor, auto&& object, 
+        tag_t<VkPipelineRenderingCreateInfoKHR>
+    ) {
+        visit(visitor, object.sType);
+        visit(visitor, object.viewMask);
+        visit_array(
+            visitor, object.pColorAttachmentFormats, 
+            object.colorAttachmentCount
+        );
+        visit(visitor, object.depthAttachmentFormat);
+        visit(visitor, object.stencilAttachmentFormat);
+    }
+
+    void visit(
+        auto&& visitor, auto&& object, tag_t<VkGraphicsPipelineCreateInfo>
+    ) {
+        visit(visitor, object.sType);
+        visit_optional(visitor, rendering_create_info(object.pNext));
+        visit(visitor, object.flags);
+        visit_array(visitor, object.pStages, object.stageCount);
+        visit_optional(visitor, object.pVertexInputState);
+        visit_optional(visitor, object.pInputAssemblyState);
+        //visit_optional(visitor, object.pTessellationState);
+        visit_optional(visitor, object.pViewportState);
+        visit_optional(visitor, object.pRasterizationState);
+        visit_optional(visitor, object.pMultisampleState);
+        visit_optional(visitor, object.pDepthStencilState);
+        visit_optional(visitor, object.pColorBlendState);
+        visit_optional(visitor, object.pDynamicState);
+        visit(visitor, object.layout);
+        visit(visitor, object.renderPass);
+        visit(visitor, object.subpass);
+    }
+
+    void visit(
+        auto&& visitor, auto&& object, tag_t<VkComputePipelineCreateInfo>
+    ) {
+        visit(visitor, object.sType);
+        //visit(visitor, object.pNext);
+        visit(visitor, object.flags);
+        visit(visitor, object.stage);
+        visit(visitor, object.layout);
+    }
+
+    void visit(auto&& visitor, auto&& object, tag_t<VkSamplerCreateInfo>) {
+        visit(visitor, object.sType);
+        //visit(visitor, object.pNext);
+        visit(visitor, object.flags);
+        visit(visitor, object.magFilter);
+        visit(visitor, object.minFilter);
+        visit(visitor, object.mipmapMode);
+        visit(visitor, object.addressModeU);
+        visit(visitor, object.addressModeV);
+        visit(visitor, object.addressModeW);
+        visit(visitor, object.mipLodBias);
+        visit(visitor, object.anisotropyEnable);
+        visit(visitor, object.maxAnisotropy);
+        visit(visitor, object.compareEnable);
+        visit(visitor, object.compareOp);
+        visit(visitor, object.minLod);
+        visit(visitor, object.maxLod);
+        visit(visitor, object.borderColor);
+        visit(visitor, object.unnormalizedCoordinates);
+    }
+
+    void visit(
+        auto&& visitor, auto&& object, tag_t<VkAttachmentDescription>
+    ) {
+        visit(visitor, object.flags);
+        visit(visitor, object.format);
+        visit(visitor, object.samples);
+        visit(visitor, object.loadOp);
+        visit(visitor, object.storeOp);
+        visit(visitor, object.stencilLoadOp);
+        visit(visitor, object.stencilStoreOp);
+        visit(visitor, object.initialLayout);
+        visit(visitor, object.finalLayout);
+    }
+
+    void visit(auto&& visitor, auto&& object, tag_t<VkAttachmentReference>) {
+        visit(visitor, object.attachment);
+        visit(visitor, object.layout);
+    }
+
+    void visit(auto&& visitor, auto&& object, tag_t<VkSubpassDescription>) {
+        visit(visitor, object.flags);
+        visit(visitor, object.pipelineBindPoint);
+        visit_array(
+            visitor, object.pInputAttachments, object.inputAttachmentCount
+        );
+        visit_array(
+            visitor, object.pColorAttachments, object.colorAttachmentCount
+        );
+        visit(visitor, object.pResolveAttachments != nullptr);
+        if (object.pResolveAttachments) {
+            visit_array(
+                visitor, object.pResolveAttachments, 
+                object.colorAttachmentCount
+            );
+        }
+        visit_optional(visitor, object.pDepthStencilAttachment);
+        visit_array(
+            visitor, object.pPreserveAttachments, 
+            object.preserveAttachmentCount
+        );
+    }
+
+    void visit(auto&& visitor, auto&& object, tag_t<VkSubpassDependency>) {
+        visit(visitor, object.srcSubpass);
+        visit(visitor, object.dstSubpass);
+        visit(visitor, object.srcStageMask);
+        visit(visitor, object.dstStageMask);
+        visit(visitor, object.srcAccessMask);
+        visit(visitor, object.dstAccessMask);
+        visit(visitor, object.dependencyFlags);
+    }
+
+    void visit(
+        auto&& visitor, auto&& object, tag_t<VkRenderPassCreateInfo>
+    ) {
+        visit(visitor, object.sType);
+        //visit(visitor, object.pNext);
+        visit(visitor, object.flags);
+        visit_array(visitor, object.pAttachments, object.attachmentCount);
+        visit_array(visitor, object.pSubpasses, object.subpassCount);
+        visit_array(visitor, object.pDependencies, object.dependencyCount);
+    }
 }
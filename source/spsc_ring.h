@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+namespace imv {
+    // Lock-free queue of variable sized records between one producer and one
+    // consumer thread. Records are contiguous and aligned to max_align_t. A
+    // full ring can be replaced by a larger one, which the consumer switches
+    // to once it drained the previous one. Waiting uses atomic waits on
+    // counters of published and consumed records.
+    class spsc_ring {
+    public:
+        explicit spsc_ring(size_t capacity) {
+            read_block = write_block = new block(capacity);
+        }
+
+        ~spsc_ring() {
+            while (read_block) {
+                auto next = read_block->next.load(std::memory_order_acquire);
+                delete read_block;
+                read_block = next;
+            }
+        }
+
+        spsc_ring(const spsc_ring&) = delete;
+        spsc_ring& operator=(const spsc_ring&) = delete;
+
+        // producer: space for a record of the size, null if the ring is full
+        std::byte* try_push(size_t size) {
+            auto& b = *write_block;
+            size_t needed = record_size(size);
+            if (needed > b.capacity)
+                return nullptr;
+            size_t head = b.head.load(std::memory_order_relaxed);
+            size_t offset = head % b.capacity;
+            // records don't wrap around, the rest of the lap is skipped
+            size_t skip = offset + needed > b.capacity ?
+                b.capacity - offset : 0;
+            size_t tail = b.tail.load(std::memory_order_acquire);
+            if (head + skip + needed - tail > b.capacity)
+                return nullptr;
+            if (skip > 0)
+                header(b, head) = 0;
+            pending = head + skip + needed;
+            header(b, head + skip) = needed;
+            return bytes(b) + (head + skip) % b.capacity + alignment;
+        }
+
+        // producer: waits until the consumer made room for the record
+        std::byte* push(size_t size) {
+            if (record_size(size) > write_block->capacity)
+                throw std::length_error("record exceeds the ring");
+            while (true) {
+                auto observed = consumed.load(std::memory_order_acquire);
+                if (auto record = try_push(size))
+                    return record;
+                consumed.wait(observed, std::memory_order_acquire);
+            }
+        }
+
+        // producer: continues in a larger ring if the record doesn't fit
+        std::byte* push_grown(size_t size) {
+            if (auto record = try_push(size))
+                return record;
+            auto previous = write_block;
+            write_block = new block(
+                std::max(previous->capacity * 2, record_size(size))
+            );
+            // nothing is written to the previous ring after this
+            previous->next.store(write_block, std::memory_order_release);
+            return try_push(size);
+        }
+
+        // producer: makes the last pushed record visible to the consumer
+        void commit() {
+            write_block->head.store(pending, std::memory_order_release);
+            published.fetch_add(1, std::memory_order_release);
+            published.notify_one();
+        }
+
+        // consumer: the oldest record, null if there is none
+        std::byte* front() {
+            while (true) {
+                auto& b = *read_block;
+                size_t tail = b.tail.load(std::memory_order_relaxed);
+                if (tail == b.head.load(std::memory_order_acquire)) {
+                    auto next = b.next.load(std::memory_order_acquire);
+                    // records committed before the switch are still read
+                    if (!next || tail != b.head.load(std::memory_order_acquire))
+                        return nullptr;
+                    delete read_block;
+                    read_block = next;
+                    continue;
+                }
+                size_t size = header(b, tail);
+                if (size == 0) {
+                    b.tail.store(
+                        tail + b.capacity - tail % b.capacity,
+                        std::memory_order_release
+                    );
+                    continue;
+                }
+                front_size = size;
+                return bytes(b) + tail % b.capacity + alignment;
+            }
+        }
+
+        // consumer: waits for a record
+        std::byte* wait_front() {
+            while (true) {
+                auto observed = published.load(std::memory_order_acquire);
+                if (auto record = front())
+                    return record;
+                published.wait(observed, std::memory_order_acquire);
+            }
+        }
+
+        // consumer: releases the record returned by front
+        void pop() {
+            auto& b = *read_block;
+            b.tail.store(
+                b.tail.load(std::memory_order_relaxed) + front_size,
+                std::memory_order_release
+            );
+            consumed.fetch_add(1, std::memory_order_release);
+            consumed.notify_one();
+        }
+
+    private:
+        static constexpr size_t alignment = alignof(std::max_align_t);
+
+        struct block {
+            explicit block(size_t size) :
+                capacity((size + alignment - 1) / alignment * alignment),
+                data(new std::max_align_t[capacity / alignment]) {}
+
+            size_t capacity;
+            // stored as max_align_t, so records are aligned to it
+            std::unique_ptr<std::max_align_t[]> data;
+            // positions only grow, the ring wraps around at capacity
+            alignas(64) std::atomic<size_t> head = 0;
+            alignas(64) std::atomic<size_t> tail = 0;
+            std::atomic<block*> next = nullptr;
+        };
+
+        // records start with their size, 0 skips the rest of the lap
+        static size_t record_size(size_t size) {
+            return (alignment + size + alignment - 1) / alignment * alignment;
+        }
+
+        static std::byte* bytes(block& b) {
+            return reinterpret_cast<std::byte*>(b.data.get());
+        }
+
+        static size_t& header(block& b, size_t position) {
+            return *reinterpret_cast<size_t*>(
+                bytes(b) + position % b.capacity
+            );
+        }
+
+        // only used by the producer
+        block* write_block;
+        size_t pending = 0;
+        // only used by the consumer
+        block* read_block;
+        size_t front_size = 0;
+
+        alignas(64) std::atomic<uint32_t> published = 0;
+        alignas(64) std::atomic<uint32_t> consumed = 0;
+    };
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace imv {
+    // Runs jobs on a fixed set of worker threads. Destroying the pool joins
+    // the workers after their current job, jobs that haven't started are
+    // dropped.
+    class thread_pool {
+    public:
+        explicit thread_pool(unsigned thread_count) {
+            for (unsigned i = 0; i < thread_count; i++) {
+                threads.emplace_back([this](std::stop_token stop) {
+                    run(stop);
+                });
+            }
+        }
+
+        void submit(std::move_only_function<void()> job) {
+            {
+                std::lock_guard lock(mutex);
+                jobs.push_back(std::move(job));
+            }
+            condition.notify_one();
+        }
+
+    private:
+        void run(std::stop_token stop) {
+            while (true) {
+                std::move_only_function<void()> job;
+                {
+                    std::unique_lock lock(mutex);
+                    if (!condition.wait(
+                        lock, stop, [this] { return !jobs.empty(); }
+                    )) {
+                        return;
+                    }
+                    job = std::move(jobs.front());
+                    jobs.pop_front();
+                }
+                job();
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable_any condition;
+        std::deque<std::move_only_function<void()>> jobs;
+        // destroyed first, requesting the workers to stop
+        std::vector<std::jthread> threads;
+    };
+}
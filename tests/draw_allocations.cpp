@@ -0,0 +1,167 @@
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <new>
+#include <optional>
+
+#define GLFW_INCLUDE_VULKAN
+#define GLFW_VULKAN_STATIC
+#include <GLFW/glfw3.h>
+
+#include <immediate_mode_vulkan/resources/vulkan_resources.h>
+#include <immediate_mode_vulkan/draw.h>
+
+// Checks that draw doesn't allocate from the heap once its caches and
+// buffers are warm. Exits with 77, which ctest reports as skipped, if no
+// window or Vulkan device is available.
+
+namespace {
+    // only counts allocations of the thread drawing
+    thread_local bool counting = false;
+    size_t allocations = 0;
+
+    constexpr int skipped = 77;
+}
+
+void* operator new(std::size_t size) {
+    if (counting)
+        allocations++;
+    if (auto pointer = std::malloc(size > 0 ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+struct unique_glfw {
+    ~unique_glfw() { glfwTerminate(); }
+};
+
+struct glfw_window_deleter {
+    typedef GLFWwindow* pointer;
+    void operator()(GLFWwindow *window) {
+        glfwDestroyWindow(window);
+    }
+};
+
+using unique_window = std::unique_ptr<GLFWwindow, glfw_window_deleter>;
+
+int main() {
+    if (glfwInit() != GLFW_TRUE)
+        return skipped;
+    unique_glfw glfw;
+
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    unique_window window{glfwCreateWindow(
+        256, 256, "draw allocations", nullptr, nullptr
+    )};
+    if (!window)
+        return skipped;
+
+    VkApplicationInfo application_info{
+        .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+        .pApplicationName = "draw allocations",
+        .apiVersion = VK_API_VERSION_1_1
+    };
+    uint32_t extension_count = 0;
+    auto extensions = glfwGetRequiredInstanceExtensions(&extension_count);
+    imv::unique_instance instance;
+    imv::unique_surface surface;
+    std::unique_ptr<imv::renderer> r;
+    try {
+        VkInstanceCreateInfo create_info{
+            .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+            .pApplicationInfo = &application_info,
+            .enabledExtensionCount = extension_count,
+            .ppEnabledExtensionNames = extensions,
+        };
+        imv::check(vkCreateInstance(
+            &create_info, nullptr, std::out_ptr(instance)
+        ));
+        imv::check(glfwCreateWindowSurface(
+            instance.get(), window.get(), nullptr,
+            imv::owned_out_ptr(surface, instance.get())
+        ));
+        r = std::make_unique<imv::renderer>(instance.get(), surface.get());
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "skipped: %s\n", e.what());
+        return skipped;
+    }
+    imv::global_renderer = r.get();
+
+    float positions[] = { -1, -1, 1, -1, -1, 1, 1, 1 };
+    auto draw = [&](
+        int i, const char* fragment, std::optional<float> depth_key,
+        std::initializer_list<imv::image_info> images = {}
+    ) {
+        struct {
+            float offset[2];
+        } uniforms = { { i * 0.01f - 0.5f, 0 } };
+        imv::draw({
+            .stages = {
+                {
+                    .code_file_name = "tests/vertex.glsl.spv",
+                    .info = { .stage = VK_SHADER_STAGE_VERTEX_BIT, }
+                }, {
+                    .code_file_name = fragment,
+                    .info = { .stage = VK_SHADER_STAGE_FRAGMENT_BIT, }
+                },
+            },
+            .vertex_input_bindings = {
+                {
+                    .buffer_source_pointer = positions,
+                    .buffer_source_size = sizeof(positions),
+                    .description = {
+                        .stride = 2 * sizeof(float),
+                        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+                    },
+                    .attributes = {
+                        { 0, 0, VK_FORMAT_R32G32_SFLOAT, },
+                    },
+                },
+            },
+            .images = images,
+            .uniform_source_pointer = &uniforms,
+            .uniform_source_size = sizeof(uniforms),
+            .vertex_count = 4,
+            .depth_key = depth_key,
+        });
+    };
+
+    // the first frames compile the pipelines, create the offscreen target
+    // and grow the frame's buffers
+    const int warm_frames = 4, frames = 8, draws_per_frame = 100;
+    for (int frame = 0; frame < frames; frame++) {
+        imv::wait_frame();
+        counting = frame >= warm_frames;
+        imv::begin_pass({
+            .color_attachments = { { .name = "offscreen" } },
+        });
+        // keyed draws are sorted when the pass ends
+        for (int i = 0; i < draws_per_frame; i++)
+            draw(i, "tests/fragment.glsl.spv", float(draws_per_frame - i));
+        imv::end_pass();
+        for (int i = 0; i < draws_per_frame; i++)
+            draw(i, "tests/fragment.glsl.spv", std::nullopt);
+        for (int i = 0; i < draws_per_frame; i++) {
+            draw(
+                i, "tests/sampled_fragment.glsl.spv", float(i),
+                { { .render_target = "offscreen" } }
+            );
+        }
+        counting = false;
+        imv::submit();
+    }
+
+    std::printf(
+        "%zu allocations in %d steady state draws\n", allocations,
+        (frames - warm_frames) * draws_per_frame * 3
+    );
+    return allocations == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,8 @@
+#version 450
+#pragma shader_stage(fragment)
+
+layout(location = 0) out vec4 fragment_color;
+
+void main() {
+    fragment_color = vec4(1.0);
+}
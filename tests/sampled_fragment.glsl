@@ -0,0 +1,10 @@
+#version 450
+#pragma shader_stage(fragment)
+
+layout(binding = 0) uniform sampler2D offscreen;
+
+layout(location = 0) out vec4 fragment_color;
+
+void main() {
+    fragment_color = texelFetch(offscreen, ivec2(gl_FragCoord.xy), 0);
+}
@@ -0,0 +1,12 @@
+#version 450
+#pragma shader_stage(vertex)
+
+layout (push_constant) uniform parameters {
+    vec2 offset;
+};
+
+layout (location = 0) in vec2 position;
+
+void main() {
+    gl_Position = vec4(position * 0.1 + offset, 0.0, 1.0);
+}